@@ -14,3 +14,23 @@ void Benchmark::CalculateAverageRenderTime(float lastRenderTime)
 	m_RenderIterations++;
 	m_averageRenderTime = m_TotalRenderTime / m_RenderIterations;
 }
+
+void Benchmark::StoreBaseline(float samplesPerSecond)
+{
+	m_BaselineSamplesPerSecond = samplesPerSecond;
+	ResetAverage();
+}
+
+const Benchmark::ScalingResult& Benchmark::AddScalingResult(uint32_t threadCount, float frameTime)
+{
+	ScalingResult& result = m_ScalingResults.emplace_back();
+	result.ThreadCount = threadCount;
+	result.FrameTime = frameTime;
+
+	// Speedup over a single thread, assuming the first result scaled perfectly
+	const ScalingResult& reference = m_ScalingResults.front();
+	result.Speedup = reference.FrameTime / frameTime * reference.ThreadCount;
+	result.Efficiency = result.Speedup / threadCount;
+
+	return result;
+}
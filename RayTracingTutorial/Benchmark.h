@@ -1,5 +1,6 @@
 #pragma once
 #include <cstdint>
+#include <vector>
 
 
 class Benchmark
@@ -9,8 +10,28 @@ public:
 	void CalculateAverageRenderTime(float lastRenderTime);
 	float GetAverageRenderTime() { return m_averageRenderTime; }
 
+	// Keeps the current throughput as a reference to compare the next measurements against. Frame times
+	// are no reference, the frame budget holds them near the target whatever the kernel costs.
+	void StoreBaseline(float samplesPerSecond);
+	float GetBaselineSamplesPerSecond() { return m_BaselineSamplesPerSecond; }
+
+	struct ScalingResult
+	{
+		uint32_t ThreadCount;
+		float FrameTime;
+		// Speedup over one thread, efficiency is speedup per thread
+		float Speedup;
+		float Efficiency;
+	};
+
+	void ResetScaling() { m_ScalingResults.clear(); }
+	const ScalingResult& AddScalingResult(uint32_t threadCount, float frameTime);
+	const std::vector<ScalingResult>& GetScalingResults() { return m_ScalingResults; }
+
 private:
 	float m_averageRenderTime = 0.0f;
 	uint32_t m_RenderIterations = 0;
 	float m_TotalRenderTime = 0.0f;
+	float m_BaselineSamplesPerSecond = 0.0f;
+	std::vector<ScalingResult> m_ScalingResults;
 };
\ No newline at end of file
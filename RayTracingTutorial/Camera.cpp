@@ -102,6 +102,20 @@ void Camera::OnResize(uint32_t width, uint32_t height)
 	RecalculateRayDirections();
 }
 
+void Camera::SetPose(const glm::vec3& position, const glm::vec3& direction)
+{
+	m_Position = position;
+	m_ForwardDirection = glm::normalize(direction);
+
+	RecalculateView();
+	RecalculateRayDirections();
+}
+
+float Camera::GetPixelSpreadAngle() const
+{
+	return std::atan(2.0f * std::tan(glm::radians(m_VerticalFOV) * 0.5f) / (float)m_ViewportHeight);
+}
+
 float Camera::GetRotationSpeed()
 {
 	return 0.3f;
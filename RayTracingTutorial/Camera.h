@@ -10,6 +10,7 @@ public:
 
 	bool OnUpdate(float ts);
 	void OnResize(uint32_t width, uint32_t height);
+	void SetPose(const glm::vec3& position, const glm::vec3& direction);
 
 	const glm::mat4& GetProjection() const { return m_Projection; }
 	const glm::mat4& GetInverseProjection() const { return m_InverseProjection; }
@@ -20,6 +21,8 @@ public:
 	const glm::vec3& GetDirection() const { return m_ForwardDirection; }
 
 	const std::vector<glm::vec3>& GetRayDirections() const { return m_RayDirections; }
+	// Angle between the rays of neighbouring pixels, the spread of a ray cone through one pixel
+	float GetPixelSpreadAngle() const;
 
 	float GetRotationSpeed();
 private:
@@ -0,0 +1,237 @@
+#include "Checkpoint.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+	constexpr uint32_t CheckpointMagic = 0x4B435452; // "RTCK"
+	constexpr uint32_t CheckpointVersion = 1;
+
+	struct CheckpointHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t Width, Height;
+		uint32_t FrameIndex;
+		uint32_t SchedulerCursor;
+		uint32_t TileCount;
+		uint32_t Reserved;
+		uint64_t SceneHash;
+		uint64_t ProjectionHash;
+		glm::vec3 CameraPosition;
+		glm::vec3 CameraDirection;
+	};
+
+	// FNV-1a
+	class Hasher
+	{
+	public:
+		void Add(const void* data, size_t size)
+		{
+			const uint8_t* bytes = (const uint8_t*)data;
+			for (size_t i = 0; i < size; i++)
+			{
+				m_Hash ^= bytes[i];
+				m_Hash *= 1099511628211ull;
+			}
+		}
+
+		template<typename T>
+		void Add(const T& value) { Add(&value, sizeof(T)); }
+
+		uint64_t Get() const { return m_Hash; }
+	private:
+		uint64_t m_Hash = 14695981039346656037ull;
+	};
+}
+
+void Checkpoint::SetView(const Scene& scene, const Camera& camera)
+{
+	SceneHash = HashScene(scene);
+	ProjectionHash = HashProjection(camera);
+	CameraPosition = camera.GetPosition();
+	CameraDirection = camera.GetDirection();
+}
+
+bool Checkpoint::MatchesView(const Scene& scene, const Camera& camera) const
+{
+	return SceneHash == HashScene(scene) && ProjectionHash == HashProjection(camera);
+}
+
+bool Checkpoint::WriteToFile(const std::string& filepath) const
+{
+	// Written next to the target and moved over it, a crash mid-write keeps the previous checkpoint intact
+	std::string tempFilepath = filepath + ".tmp";
+
+	{
+		std::ofstream file(tempFilepath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			std::cout << "could not open checkpoint file " << tempFilepath << std::endl;
+			return false;
+		}
+
+		CheckpointHeader header{};
+		header.Magic = CheckpointMagic;
+		header.Version = CheckpointVersion;
+		header.Width = Width;
+		header.Height = Height;
+		header.FrameIndex = FrameIndex;
+		header.SchedulerCursor = SchedulerCursor;
+		header.TileCount = (uint32_t)TileFrameIndex.size();
+		header.SceneHash = SceneHash;
+		header.ProjectionHash = ProjectionHash;
+		header.CameraPosition = CameraPosition;
+		header.CameraDirection = CameraDirection;
+
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)TileFrameIndex.data(), TileFrameIndex.size() * sizeof(uint32_t));
+		file.write((const char*)AccumulationData.data(), AccumulationData.size() * sizeof(glm::vec3));
+
+		if (!file.good())
+		{
+			std::cout << "could not write checkpoint file " << tempFilepath << std::endl;
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempFilepath, filepath, error);
+	if (error)
+	{
+		std::cout << "could not replace checkpoint file " << filepath << ": " << error.message() << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool Checkpoint::ReadFromFile(const std::string& filepath)
+{
+	std::ifstream file(filepath, std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cout << "could not open checkpoint file " << filepath << std::endl;
+		return false;
+	}
+
+	CheckpointHeader header{};
+	file.read((char*)&header, sizeof(header));
+	if (!file.good() || header.Magic != CheckpointMagic || header.Version != CheckpointVersion)
+	{
+		std::cout << filepath << " is not a supported checkpoint file" << std::endl;
+		return false;
+	}
+
+	Width = header.Width;
+	Height = header.Height;
+	FrameIndex = header.FrameIndex;
+	SchedulerCursor = header.SchedulerCursor;
+	SceneHash = header.SceneHash;
+	ProjectionHash = header.ProjectionHash;
+	CameraPosition = header.CameraPosition;
+	CameraDirection = header.CameraDirection;
+
+	// Sizes come from the file, they are checked against its length before anything is allocated
+	uint64_t payloadSize = (uint64_t)header.TileCount * sizeof(uint32_t) + (uint64_t)Width * Height * sizeof(glm::vec3);
+	std::error_code error;
+	uint64_t fileSize = std::filesystem::file_size(filepath, error);
+	if (error || fileSize < sizeof(header) || payloadSize > fileSize - sizeof(header))
+	{
+		std::cout << "checkpoint file " << filepath << " is truncated" << std::endl;
+		return false;
+	}
+
+	TileFrameIndex.resize(header.TileCount);
+	AccumulationData.resize((size_t)Width * Height);
+
+	file.read((char*)TileFrameIndex.data(), TileFrameIndex.size() * sizeof(uint32_t));
+	file.read((char*)AccumulationData.data(), AccumulationData.size() * sizeof(glm::vec3));
+	if (!file.good())
+	{
+		std::cout << "checkpoint file " << filepath << " is truncated" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+uint64_t Checkpoint::HashScene(const Scene& scene)
+{
+	Hasher hasher;
+
+	for (const Material& material : scene.Materials)
+	{
+		hasher.Add(material.Albedo);
+		hasher.Add(material.Roughness);
+		hasher.Add(material.Metallic);
+		hasher.Add(material.EmissionColor);
+		hasher.Add(material.EmissionPower);
+		hasher.Add(material.TextureIndex);
+	}
+
+	for (uint32_t i = 0; i < scene.Textures->GetTextureCount(); i++)
+	{
+		const std::string& filepath = scene.Textures->GetTexture((int)i).GetFilepath();
+		hasher.Add(filepath.data(), filepath.size());
+	}
+
+	for (const Model* model : scene.Models)
+	{
+		hasher.Add(model->m_materialIndex);
+		hasher.Add(model->Position);
+
+		for (const Triangle* triangle : model->m_triangles)
+		{
+			hasher.Add(triangle->A);
+			hasher.Add(triangle->B);
+			hasher.Add(triangle->C);
+			hasher.Add(triangle->Normal);
+			hasher.Add(triangle->UVA);
+			hasher.Add(triangle->UVB);
+			hasher.Add(triangle->UVC);
+		}
+	}
+
+	return hasher.Get();
+}
+
+uint64_t Checkpoint::HashProjection(const Camera& camera)
+{
+	Hasher hasher;
+	hasher.Add(camera.GetProjection());
+	return hasher.Get();
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+	Wait();
+}
+
+bool CheckpointWriter::WriteAsync(const std::string& filepath, Checkpoint&& checkpoint)
+{
+	if (IsBusy())
+		return false;
+
+	Wait();
+
+	m_Pending = std::async(std::launch::async, [filepath, checkpoint = std::move(checkpoint)]()
+		{
+			return checkpoint.WriteToFile(filepath);
+		});
+
+	return true;
+}
+
+bool CheckpointWriter::IsBusy() const
+{
+	return m_Pending.valid() && m_Pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+}
+
+void CheckpointWriter::Wait()
+{
+	if (m_Pending.valid())
+		m_LastResult = m_Pending.get();
+}
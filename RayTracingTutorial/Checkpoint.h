@@ -0,0 +1,55 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "Scene.h"
+#include "Camera.h"
+
+// Snapshot of a progressive render that can be written to disk and resumed from.
+// Samples are seeded from the pixel position and the per tile sample index, so the
+// tile sample indices are the complete sampler state.
+struct Checkpoint
+{
+	uint32_t Width = 0, Height = 0;
+	uint32_t FrameIndex = 1;
+	uint32_t SchedulerCursor = 0;
+	std::vector<uint32_t> TileFrameIndex;
+
+	// Accumulated radiance, alpha is implied by the tile sample index and not stored
+	std::vector<glm::vec3> AccumulationData;
+
+	uint64_t SceneHash = 0;
+	uint64_t ProjectionHash = 0;
+	glm::vec3 CameraPosition{ 0.0f };
+	glm::vec3 CameraDirection{ 0.0f };
+
+	void SetView(const Scene& scene, const Camera& camera);
+	bool MatchesView(const Scene& scene, const Camera& camera) const;
+
+	bool WriteToFile(const std::string& filepath) const;
+	bool ReadFromFile(const std::string& filepath);
+
+	static uint64_t HashScene(const Scene& scene);
+	static uint64_t HashProjection(const Camera& camera);
+};
+
+// Writes checkpoints on a background thread so rendering does not stall on disk I/O
+class CheckpointWriter
+{
+public:
+	~CheckpointWriter();
+
+	// Returns false while the previous checkpoint is still being written
+	bool WriteAsync(const std::string& filepath, Checkpoint&& checkpoint);
+	bool IsBusy() const;
+	bool GetLastResult() const { return m_LastResult; }
+private:
+	void Wait();
+private:
+	std::future<bool> m_Pending;
+	bool m_LastResult = true;
+};
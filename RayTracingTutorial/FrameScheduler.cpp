@@ -0,0 +1,117 @@
+#include "FrameScheduler.h"
+
+#include <glm/glm.hpp>
+
+namespace
+{
+	// Weight of the newest measurement in the running averages
+	constexpr float SmoothingFactor = 0.25f;
+}
+
+void FrameScheduler::Reset(uint32_t tileCount)
+{
+	m_TileTimes.assign(tileCount, 0.0f);
+	m_Waves.clear();
+	m_Cursor = 0;
+
+	m_AverageTileTime = 0.0f;
+	m_FrameTimeScale = 0.0f;
+	m_PredictedFrameTime = 0.0f;
+}
+
+const std::vector<FrameScheduler::Wave>& FrameScheduler::Schedule(float targetFrameTime, uint32_t maxSamplesPerTile)
+{
+	m_Waves.clear();
+
+	uint32_t tileCount = (uint32_t)m_TileTimes.size();
+	if (tileCount == 0)
+		return m_Waves;
+
+	// Without a budget, or before anything was measured, render one full pass
+	if (targetFrameTime <= 0.0f || m_FrameTimeScale <= 0.0f)
+	{
+		m_Waves.push_back({ m_Cursor, tileCount });
+		if (m_Cursor > 0)
+			m_Waves.push_back({ 0, m_Cursor });
+
+		m_PredictedFrameTime = 0.0f;
+		return m_Waves;
+	}
+
+	float budget = targetFrameTime / m_FrameTimeScale;
+	float predicted = 0.0f;
+
+	uint64_t maxTiles = (uint64_t)tileCount * glm::max(maxSamplesPerTile, 1u);
+	uint64_t scheduled = 0;
+
+	uint32_t begin = m_Cursor;
+	uint32_t tile = m_Cursor;
+
+	// Always make progress, even if a single tile is more expensive than the whole budget
+	while (scheduled < maxTiles && (scheduled == 0 || predicted < budget))
+	{
+		predicted += PredictTileTime(tile);
+		scheduled++;
+		tile++;
+
+		if (tile == tileCount)
+		{
+			m_Waves.push_back({ begin, tileCount });
+			begin = 0;
+			tile = 0;
+		}
+	}
+
+	if (tile > begin)
+		m_Waves.push_back({ begin, tile });
+
+	m_Cursor = tile;
+	m_PredictedFrameTime = predicted * m_FrameTimeScale;
+
+	return m_Waves;
+}
+
+void FrameScheduler::RecordTileTime(uint32_t tile, float milliseconds)
+{
+	float& tileTime = m_TileTimes[tile];
+	tileTime = tileTime > 0.0f ? glm::mix(tileTime, milliseconds, SmoothingFactor) : milliseconds;
+}
+
+void FrameScheduler::EndFrame(float frameTime, uint64_t samples)
+{
+	float tileTimeSum = 0.0f;
+	uint32_t tilesRendered = 0;
+
+	for (const Wave& wave : m_Waves)
+	{
+		for (uint32_t tile = wave.Begin; tile < wave.End; tile++)
+			tileTimeSum += m_TileTimes[tile];
+
+		tilesRendered += wave.End - wave.Begin;
+	}
+
+	if (tilesRendered == 0 || tileTimeSum <= 0.0f || frameTime <= 0.0f)
+		return;
+
+	float averageTileTime = tileTimeSum / (float)tilesRendered;
+	float frameTimeScale = frameTime / tileTimeSum;
+	float samplesPerSecond = (float)samples / (frameTime * 0.001f);
+
+	if (m_FrameTimeScale <= 0.0f)
+	{
+		m_AverageTileTime = averageTileTime;
+		m_FrameTimeScale = frameTimeScale;
+		m_SamplesPerSecond = samplesPerSecond;
+		return;
+	}
+
+	m_AverageTileTime = glm::mix(m_AverageTileTime, averageTileTime, SmoothingFactor);
+	m_FrameTimeScale = glm::mix(m_FrameTimeScale, frameTimeScale, SmoothingFactor);
+	m_SamplesPerSecond = glm::mix(m_SamplesPerSecond, samplesPerSecond, SmoothingFactor);
+}
+
+float FrameScheduler::PredictTileTime(uint32_t tile) const
+{
+	// Tiles that were never rendered are assumed to cost as much as an average one
+	return m_TileTimes[tile] > 0.0f ? m_TileTimes[tile] : m_AverageTileTime;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Decides how many image tiles are rendered in a frame so the frame stays within a time budget.
+// Tiles are handed out in order from a cursor that carries over between frames: work that
+// does not fit into this frame continues in the next one, and cheap frames get more than
+// one sample per tile.
+class FrameScheduler
+{
+public:
+	// Contiguous range of tile indices, every tile appears at most once within a wave
+	struct Wave
+	{
+		uint32_t Begin;
+		uint32_t End;
+	};
+
+	void Reset(uint32_t tileCount);
+
+	// A target frame time of 0 schedules exactly one sample for every tile
+	const std::vector<Wave>& Schedule(float targetFrameTime, uint32_t maxSamplesPerTile);
+
+	// Thread safe as long as every tile is recorded by a single thread per wave
+	void RecordTileTime(uint32_t tile, float milliseconds);
+	void EndFrame(float frameTime, uint64_t samples);
+
+	uint32_t GetCursor() const { return m_Cursor; }
+	void SetCursor(uint32_t cursor) { m_Cursor = cursor < m_TileTimes.size() ? cursor : 0; }
+
+	float GetSamplesPerSecond() const { return m_SamplesPerSecond; }
+	float GetPredictedFrameTime() const { return m_PredictedFrameTime; }
+private:
+	float PredictTileTime(uint32_t tile) const;
+private:
+	std::vector<float> m_TileTimes;
+	std::vector<Wave> m_Waves;
+	uint32_t m_Cursor = 0;
+
+	float m_AverageTileTime = 0.0f;
+	// Frame time per millisecond of summed tile time, accounts for the tiles running in parallel
+	float m_FrameTimeScale = 0.0f;
+
+	float m_PredictedFrameTime = 0.0f;
+	float m_SamplesPerSecond = 0.0f;
+};
@@ -2,6 +2,8 @@
 
 #include "Model.h"
 
+#include <cmath>
+
 
 Model::Model() {
 }
@@ -22,8 +24,31 @@ void Model::MakeTriangles() {
 		triangle->Normal = *(m_normals[face->normal - 1]);
 		triangle->Position = { 0.0f, 0.0f, 0.0f };
 
+		// Faces without texture coordinates keep them at zero
+		if (face->texture_ins[0] > 0 && face->texture_ins[1] > 0 && face->texture_ins[2] > 0) {
+			triangle->UVA = *(m_texcoords[face->texture_ins[0] - 1]);
+			triangle->UVB = *(m_texcoords[face->texture_ins[1] - 1]);
+			triangle->UVC = *(m_texcoords[face->texture_ins[2] - 1]);
+		}
+
+		glm::vec2 uvEdgeB = triangle->UVB - triangle->UVA;
+		glm::vec2 uvEdgeC = triangle->UVC - triangle->UVA;
+		float uvArea = std::abs(uvEdgeB.x * uvEdgeC.y - uvEdgeB.y * uvEdgeC.x);
+		float worldArea = glm::length(glm::cross(triangle->B - triangle->A, triangle->C - triangle->A));
+		if (uvArea > 0.0f && worldArea > 0.0f)
+			triangle->TextureLod = 0.5f * std::log2(uvArea / worldArea);
+
 		m_triangles.push_back(triangle);
 	}
+
+	if (m_triangles.empty())
+		return;
+
+	m_boundsMin = m_boundsMax = m_triangles[0]->A;
+	for (auto t : m_triangles) {
+		m_boundsMin = glm::min(m_boundsMin, glm::min(t->A, glm::min(t->B, t->C)));
+		m_boundsMax = glm::max(m_boundsMax, glm::max(t->A, glm::max(t->B, t->C)));
+	}
 }
 
 void Model::CleanTrash() {
@@ -33,6 +58,9 @@ void Model::CleanTrash() {
 	for (auto vn : m_normals)
 		delete vn;
 
+	for (auto vt : m_texcoords)
+		delete vt;
+
 	for (auto f : m_faces)
 		delete f;
 }
@@ -58,6 +86,11 @@ void Model::LoadFromOBJ(const char* filename) {
 				ss >> vn->x >> vn->y >> vn->z;
 				m_normals.push_back(vn);
 			}
+			else if (prefix == "vt") {
+				glm::vec2* vt = new glm::vec2;
+				ss >> vt->x >> vt->y;
+				m_texcoords.push_back(vt);
+			}
 			else if (prefix == "f") {
 				Face* face = new Face;
 
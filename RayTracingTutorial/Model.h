@@ -12,7 +12,7 @@
 struct Face
 {
 	int vertex_ins[3];
-	int texture_ins[3];
+	int texture_ins[3] = { 0, 0, 0 };
 	int normal;
 };
 
@@ -27,10 +27,15 @@ public:
 	int m_triangleCount = 0;
 	std::vector<glm::vec3*> m_verticies;
 	std::vector<glm::vec3*> m_normals;
+	std::vector<glm::vec2*> m_texcoords;
 	std::vector<Face*> m_faces;
 	std::vector<Triangle*> m_triangles;
 	glm::vec3 Position{ 0.0f };
 
+	// Model space bounding box of all triangles
+	glm::vec3 m_boundsMin{ 0.0f };
+	glm::vec3 m_boundsMax{ 0.0f };
+
 	void PrintAll();
 
 private:
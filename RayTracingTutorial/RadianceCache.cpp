@@ -0,0 +1,285 @@
+#include "RadianceCache.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	constexpr float Pi = 3.14159265358979f;
+
+	// Slots probed after the hashed one before giving up on a cell
+	constexpr uint32_t MaxProbes = 8;
+	// Weight of a new frame once a bin has seen enough samples, before that it is a plain average
+	constexpr float LearningRate = 0.2f;
+	// Share of the guide distribution that stays uniform, so no bin ever has zero probability
+	constexpr float UniformFraction = 0.2f;
+	constexpr uint32_t MinTrainedSamples = 32;
+	// Cells that have not been trained for this many frames are freed for other surfaces
+	constexpr uint32_t MaxCellAge = 256;
+
+	void AtomicAdd(std::atomic<float>& target, float value)
+	{
+		float current = target.load(std::memory_order_relaxed);
+		while (!target.compare_exchange_weak(current, current + value, std::memory_order_relaxed))
+			;
+	}
+
+	// splitmix64 finalizer
+	uint64_t Hash(uint64_t key)
+	{
+		key ^= key >> 30;
+		key *= 0xbf58476d1ce4e5b9ull;
+		key ^= key >> 27;
+		key *= 0x94d049bb133111ebull;
+		key ^= key >> 31;
+		return key;
+	}
+
+	// Orthonormal basis around a unit vector (Duff et al. 2017)
+	void MakeBasis(const glm::vec3& normal, glm::vec3& tangent, glm::vec3& bitangent)
+	{
+		float sign = std::copysign(1.0f, normal.z);
+		float a = -1.0f / (sign + normal.z);
+		float b = normal.x * normal.y * a;
+		tangent = glm::vec3(1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+		bitangent = glm::vec3(b, sign + normal.y * normal.y * a, -normal.y);
+	}
+
+	float Luminance(const glm::vec3& color)
+	{
+		return 0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b;
+	}
+}
+
+RadianceCache::RadianceCache(uint32_t capacity, float cellSize)
+{
+	Configure(capacity, cellSize);
+}
+
+void RadianceCache::Configure(uint32_t capacity, float cellSize)
+{
+	uint32_t powerOfTwo = 1;
+	while (powerOfTwo < capacity)
+		powerOfTwo <<= 1;
+
+	if (powerOfTwo != m_Capacity)
+	{
+		m_Cells = std::make_unique<Cell[]>(powerOfTwo);
+		m_Capacity = powerOfTwo;
+	}
+
+	m_CellSize = cellSize;
+	Clear();
+}
+
+void RadianceCache::Clear()
+{
+	for (uint32_t i = 0; i < m_Capacity; i++)
+		ResetCell(m_Cells[i]);
+
+	m_CellCount = 0;
+}
+
+int32_t RadianceCache::FindOrInsertCell(const glm::vec3& position, const glm::vec3& normal)
+{
+	uint64_t key = MakeKey(position, normal);
+	uint32_t mask = m_Capacity - 1;
+	uint32_t start = (uint32_t)Hash(key) & mask;
+
+	// Freed slots can sit in front of a cell, so every probe is checked before inserting
+	for (uint32_t i = 0; i < MaxProbes; i++)
+	{
+		uint32_t index = (start + i) & mask;
+		if (m_Cells[index].Key.load(std::memory_order_relaxed) == key)
+			return (int32_t)index;
+	}
+
+	for (uint32_t i = 0; i < MaxProbes; i++)
+	{
+		uint32_t index = (start + i) & mask;
+		uint64_t expected = 0;
+		if (m_Cells[index].Key.compare_exchange_strong(expected, key, std::memory_order_relaxed) || expected == key)
+			return (int32_t)index;
+	}
+
+	return -1;
+}
+
+uint32_t RadianceCache::GetBin(const glm::vec3& normal, const glm::vec3& direction)
+{
+	glm::vec3 tangent, bitangent;
+	MakeBasis(normal, tangent, bitangent);
+
+	float cosine = std::clamp(glm::dot(direction, normal), 0.0f, 1.0f);
+	float azimuth = std::atan2(glm::dot(direction, bitangent), glm::dot(direction, tangent));
+	if (azimuth < 0.0f)
+		azimuth += 2.0f * Pi;
+
+	uint32_t ring = std::min((uint32_t)(cosine * CosineBins), CosineBins - 1);
+	uint32_t sector = std::min((uint32_t)(azimuth * AzimuthBins / (2.0f * Pi)), AzimuthBins - 1);
+	return sector + ring * AzimuthBins;
+}
+
+glm::vec3 RadianceCache::SampleDirection(int32_t cell, const glm::vec3& normal, float u0, float u1, float u2) const
+{
+	const float* cdf = m_Cells[cell].Cdf;
+
+	uint32_t bin = 0;
+	while (bin < BinCount - 1 && u0 >= cdf[bin])
+		bin++;
+
+	// Uniform in cosine is uniform in solid angle
+	float cosine = ((bin / AzimuthBins) + u1) / CosineBins;
+	float azimuth = ((bin % AzimuthBins) + u2) * 2.0f * Pi / AzimuthBins;
+	float sine = std::sqrt(std::max(0.0f, 1.0f - cosine * cosine));
+
+	glm::vec3 tangent, bitangent;
+	MakeBasis(normal, tangent, bitangent);
+	return tangent * (sine * std::cos(azimuth)) + bitangent * (sine * std::sin(azimuth)) + normal * cosine;
+}
+
+float RadianceCache::GetPdf(int32_t cell, uint32_t bin) const
+{
+	const float* cdf = m_Cells[cell].Cdf;
+	float probability = bin > 0 ? cdf[bin] - cdf[bin - 1] : cdf[0];
+
+	// Every bin spans 2 pi / BinCount steradians
+	return probability * BinCount / (2.0f * Pi);
+}
+
+void RadianceCache::AddSample(int32_t cell, uint32_t bin, const glm::vec3& radiance, float diffuseWeight)
+{
+	Cell& target = m_Cells[cell];
+
+	AtomicAdd(target.TrainRadiance[bin], Luminance(radiance));
+	target.TrainSamples[bin].fetch_add(1, std::memory_order_relaxed);
+
+	if (diffuseWeight > 0.0f)
+	{
+		AtomicAdd(target.TrainDiffuse[0], radiance.r * diffuseWeight);
+		AtomicAdd(target.TrainDiffuse[1], radiance.g * diffuseWeight);
+		AtomicAdd(target.TrainDiffuse[2], radiance.b * diffuseWeight);
+		AtomicAdd(target.TrainDiffuseWeight, diffuseWeight);
+	}
+}
+
+void RadianceCache::EndFrame()
+{
+	m_Frame++;
+	m_CellCount = 0;
+
+	for (uint32_t i = 0; i < m_Capacity; i++)
+	{
+		Cell& cell = m_Cells[i];
+		if (cell.Key.load(std::memory_order_relaxed) == 0)
+			continue;
+
+		bool trained = false;
+		for (uint32_t bin = 0; bin < BinCount; bin++)
+		{
+			uint32_t samples = cell.TrainSamples[bin].load(std::memory_order_relaxed);
+			if (samples == 0)
+				continue;
+
+			float radiance = cell.TrainRadiance[bin].load(std::memory_order_relaxed) / samples;
+			cell.Samples[bin] += samples;
+			cell.TotalSamples += samples;
+
+			float rate = std::max(LearningRate, (float)samples / cell.Samples[bin]);
+			cell.Radiance[bin] += (radiance - cell.Radiance[bin]) * rate;
+
+			cell.TrainRadiance[bin].store(0.0f, std::memory_order_relaxed);
+			cell.TrainSamples[bin].store(0, std::memory_order_relaxed);
+			trained = true;
+		}
+
+		float diffuseWeight = cell.TrainDiffuseWeight.load(std::memory_order_relaxed);
+		if (diffuseWeight > 0.0f)
+		{
+			glm::vec3 radiance = glm::vec3(
+				cell.TrainDiffuse[0].load(std::memory_order_relaxed),
+				cell.TrainDiffuse[1].load(std::memory_order_relaxed),
+				cell.TrainDiffuse[2].load(std::memory_order_relaxed)) / diffuseWeight;
+
+			cell.DiffuseWeight += diffuseWeight;
+			float rate = std::max(LearningRate, diffuseWeight / cell.DiffuseWeight);
+			cell.DiffuseRadiance += (radiance - cell.DiffuseRadiance) * rate;
+
+			for (std::atomic<float>& channel : cell.TrainDiffuse)
+				channel.store(0.0f, std::memory_order_relaxed);
+			cell.TrainDiffuseWeight.store(0.0f, std::memory_order_relaxed);
+		}
+
+		if (trained)
+		{
+			cell.LastTrainedFrame = m_Frame;
+			UpdateDistribution(cell);
+		}
+		else if (m_Frame - cell.LastTrainedFrame > MaxCellAge)
+		{
+			ResetCell(cell);
+			continue;
+		}
+
+		m_CellCount++;
+	}
+}
+
+uint64_t RadianceCache::MakeKey(const glm::vec3& position, const glm::vec3& normal) const
+{
+	// 20 bits per position axis, the dominant normal axis and its sign, and a set top bit so no key is 0
+	uint64_t key = 1ull << 63;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		int32_t coordinate = (int32_t)std::floor(position[axis] / m_CellSize);
+		key |= (uint64_t)(coordinate & 0xfffff) << (axis * 20);
+	}
+
+	glm::vec3 magnitude = glm::abs(normal);
+	int axis = magnitude.x > magnitude.y ? (magnitude.x > magnitude.z ? 0 : 2) : (magnitude.y > magnitude.z ? 1 : 2);
+	uint64_t orientation = axis * 2 + (normal[axis] < 0.0f ? 1 : 0);
+	return key | (orientation << 60);
+}
+
+void RadianceCache::ResetCell(Cell& cell)
+{
+	cell.Key.store(0, std::memory_order_relaxed);
+
+	for (uint32_t bin = 0; bin < BinCount; bin++)
+	{
+		cell.TrainRadiance[bin].store(0.0f, std::memory_order_relaxed);
+		cell.TrainSamples[bin].store(0, std::memory_order_relaxed);
+		cell.Radiance[bin] = 0.0f;
+		cell.Samples[bin] = 0;
+		cell.Cdf[bin] = 0.0f;
+	}
+
+	for (std::atomic<float>& channel : cell.TrainDiffuse)
+		channel.store(0.0f, std::memory_order_relaxed);
+	cell.TrainDiffuseWeight.store(0.0f, std::memory_order_relaxed);
+
+	cell.DiffuseRadiance = glm::vec3(0.0f);
+	cell.DiffuseWeight = 0.0f;
+	cell.TotalSamples = 0;
+	cell.LastTrainedFrame = m_Frame;
+	cell.Trained = false;
+}
+
+void RadianceCache::UpdateDistribution(Cell& cell)
+{
+	float total = 0.0f;
+	for (uint32_t bin = 0; bin < BinCount; bin++)
+		total += cell.Radiance[bin];
+
+	cell.Trained = total > 0.0f && cell.TotalSamples >= MinTrainedSamples;
+	if (!cell.Trained)
+		return;
+
+	float sum = 0.0f;
+	for (uint32_t bin = 0; bin < BinCount; bin++)
+	{
+		sum += (1.0f - UniformFraction) * cell.Radiance[bin] / total + UniformFraction / BinCount;
+		cell.Cdf[bin] = sum;
+	}
+	cell.Cdf[BinCount - 1] = 1.0f;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Hashed grid over surface positions and orientations that learns the incoming radiance of
+// every cell across frames. Radiance is kept per direction bin of the hemisphere around the
+// surface normal: 8 azimuth sectors by 4 rings of equal cosine width, so all 32 bins cover the
+// same solid angle. Render threads add samples to a training buffer and EndFrame blends it into
+// the read buffer that the next frame samples from, so reads never race with writes.
+class RadianceCache
+{
+public:
+	static constexpr uint32_t AzimuthBins = 8;
+	static constexpr uint32_t CosineBins = 4;
+	static constexpr uint32_t BinCount = AzimuthBins * CosineBins;
+
+	// The capacity is rounded up to a power of two and never grows, cells that are full stop learning
+	explicit RadianceCache(uint32_t capacity = 1 << 15, float cellSize = 0.25f);
+
+	// Drops everything learned
+	void Configure(uint32_t capacity, float cellSize);
+	void Clear();
+
+	// Returns -1 when every probed slot is taken by other cells
+	int32_t FindOrInsertCell(const glm::vec3& position, const glm::vec3& normal);
+
+	// Directions are binned in the hemisphere around the normal
+	static uint32_t GetBin(const glm::vec3& normal, const glm::vec3& direction);
+
+	// Only trained cells may be sampled
+	bool IsTrained(int32_t cell) const { return m_Cells[cell].Trained; }
+	// Picks a bin proportionally to its radiance and a direction uniformly within it, u are in [0, 1)
+	glm::vec3 SampleDirection(int32_t cell, const glm::vec3& normal, float u0, float u1, float u2) const;
+	// Solid angle pdf of SampleDirection
+	float GetPdf(int32_t cell, uint32_t bin) const;
+	// Incoming radiance averaged over the cosine lobe, an estimate of the rest of a diffuse path
+	const glm::vec3& GetDiffuseRadiance(int32_t cell) const { return m_Cells[cell].DiffuseRadiance; }
+
+	// Thread safe, the diffuse weight is the cosine lobe pdf over the pdf the direction was sampled with
+	void AddSample(int32_t cell, uint32_t bin, const glm::vec3& radiance, float diffuseWeight);
+	// Must not run while samples are added or cells are read
+	void EndFrame();
+
+	uint32_t GetCapacity() const { return m_Capacity; }
+	uint32_t GetCellCount() const { return m_CellCount; }
+	float GetCellSize() const { return m_CellSize; }
+	size_t GetMemoryUsage() const { return (size_t)m_Capacity * sizeof(Cell); }
+private:
+	struct Cell
+	{
+		// 0 marks an empty slot
+		std::atomic<uint64_t> Key{ 0 };
+
+		// Training buffer, written concurrently while a frame renders
+		std::atomic<float> TrainRadiance[BinCount];
+		std::atomic<uint32_t> TrainSamples[BinCount];
+		std::atomic<float> TrainDiffuse[3];
+		std::atomic<float> TrainDiffuseWeight;
+
+		// Read buffer, luminance per bin and its cumulative sampling distribution
+		float Radiance[BinCount];
+		uint32_t Samples[BinCount];
+		float Cdf[BinCount];
+		glm::vec3 DiffuseRadiance;
+		float DiffuseWeight;
+		uint32_t TotalSamples;
+		uint32_t LastTrainedFrame;
+		bool Trained;
+	};
+
+	uint64_t MakeKey(const glm::vec3& position, const glm::vec3& normal) const;
+	void ResetCell(Cell& cell);
+	void UpdateDistribution(Cell& cell);
+private:
+	std::unique_ptr<Cell[]> m_Cells;
+	uint32_t m_Capacity = 0;
+	float m_CellSize = 0.25f;
+
+	uint32_t m_Frame = 0;
+	uint32_t m_CellCount = 0;
+};
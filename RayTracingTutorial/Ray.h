@@ -1,9 +1,28 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <cstdint>
 
 struct Ray
 {
 	glm::vec3 Origin;
 	glm::vec3 Direction;
-};
\ No newline at end of file
+};
+// Square block of rays sharing one origin. Directions are stored per component and
+// aligned so that four lanes at a time can be loaded into an SSE register.
+struct RayPacket
+{
+	static constexpr uint32_t Width = 8;
+	static constexpr uint32_t Size = Width * Width;
+
+	glm::vec3 Origin;
+	alignas(16) float DirectionX[Size];
+	alignas(16) float DirectionY[Size];
+	alignas(16) float DirectionZ[Size];
+
+	// One bit per lane, lanes outside of the image are inactive
+	uint64_t ActiveMask = 0;
+
+	// Planes through the origin enclosing every direction, normals point inwards
+	glm::vec3 FrustumNormals[4];
+};
@@ -1,10 +1,16 @@
 #include "Walnut/Random.h"
+#include "Walnut/Timer.h"
 #include "Renderer.h"
 #include "Scene.h"
-#include <execution>
+#include "Checkpoint.h"
+#include <chrono>
+#include <atomic>
+#include <emmintrin.h>
 
 namespace Helpers
 {
+	constexpr float Pi = 3.14159265358979f;
+
 	static uint32_t ConvertToABGR(const glm::vec4& color)
 	{
 		uint8_t r = (uint8_t)(color.r * 255.0f);
@@ -37,94 +43,563 @@ namespace Helpers
 			RandomFloatPcg(seed) * 2.0f - 1.0f)
 		);
 	}
+
+	static bool IntersectsBox(const Ray& ray, const glm::vec3& boxMin, const glm::vec3& boxMax, float maxDistance)
+	{
+		glm::vec3 inverseDirection = 1.0f / ray.Direction;
+		glm::vec3 t0 = (boxMin - ray.Origin) * inverseDirection;
+		glm::vec3 t1 = (boxMax - ray.Origin) * inverseDirection;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+
+		float entry = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+		float exit = glm::min(glm::min(tFar.x, tFar.y), tFar.z);
+		return entry <= exit && entry < maxDistance;
+	}
+
+	// Uniform on the sphere, unlike InUnitSphere which normalizes a point in a cube and leans towards the corners
+	static glm::vec3 OnUnitSphere(uint32_t& seed)
+	{
+		float z = RandomFloatPcg(seed) * 2.0f - 1.0f;
+		float azimuth = RandomFloatPcg(seed) * 2.0f * Pi;
+		float radius = std::sqrt(std::max(0.0f, 1.0f - z * z));
+		return glm::vec3(radius * std::cos(azimuth), radius * std::sin(azimuth), z);
+	}
+
+	// Solid angle pdf of normalize(N + roughness * s) for s uniform on the unit sphere, given the cosine to N.
+	// The direction meets the sphere of radius roughness around N twice when the sphere does not contain
+	// the origin and once otherwise; a roughness of 1 gives the cosine lobe.
+	static float DiffuseLobePdf(float cosine, float roughness)
+	{
+		float discriminant = roughness * roughness - (1.0f - cosine * cosine);
+		if (cosine <= 0.0f || discriminant <= 0.0f)
+			return 0.0f;
+
+		float d = std::sqrt(discriminant);
+		if (roughness >= 1.0f)
+		{
+			float t = cosine + d;
+			return t * t / (4.0f * Pi * roughness * d);
+		}
+
+		return (cosine * cosine + d * d) / (2.0f * Pi * roughness * d);
+	}
+
+	// Spread a ray cone gains from a bounce off a fully rough surface, in radians
+	constexpr float RoughConeSpread = 1.0f;
+
+	static glm::vec2 InterpolateUV(const Triangle& triangle, const glm::vec3& point)
+	{
+		glm::vec3 edgeB = triangle.B - triangle.A;
+		glm::vec3 edgeC = triangle.C - triangle.A;
+		glm::vec3 offset = point - triangle.A;
+
+		float bb = glm::dot(edgeB, edgeB);
+		float bc = glm::dot(edgeB, edgeC);
+		float cc = glm::dot(edgeC, edgeC);
+		float ob = glm::dot(offset, edgeB);
+		float oc = glm::dot(offset, edgeC);
+		float denominator = bb * cc - bc * bc;
+		if (denominator == 0.0f)
+			return triangle.UVA;
+
+		float v = (cc * ob - bc * oc) / denominator;
+		float w = (bb * oc - bc * ob) / denominator;
+		return triangle.UVA * (1.0f - v - w) + triangle.UVB * v + triangle.UVC * w;
+	}
+
+	// Tolerance keeps geometry touching the frustum sides from being culled
+	constexpr float FrustumEpsilon = 1e-4f;
+
+	// Points are relative to the frustum apex, a box is culled when it lies completely behind one plane
+	static bool FrustumCullsBox(const glm::vec3* frustumNormals, const glm::vec3& boxMin, const glm::vec3& boxMax)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			const glm::vec3& normal = frustumNormals[i];
+			glm::vec3 farthest(
+				normal.x >= 0.0f ? boxMax.x : boxMin.x,
+				normal.y >= 0.0f ? boxMax.y : boxMin.y,
+				normal.z >= 0.0f ? boxMax.z : boxMin.z);
+
+			if (glm::dot(normal, farthest) < -FrustumEpsilon)
+				return true;
+		}
+		return false;
+	}
+
+	// Four packet lanes of a vector, one component per SSE register
+	struct LaneVec3
+	{
+		__m128 X, Y, Z;
+	};
+
+	static LaneVec3 Splat(const glm::vec3& v)
+	{
+		return { _mm_set1_ps(v.x), _mm_set1_ps(v.y), _mm_set1_ps(v.z) };
+	}
+
+	static LaneVec3 Sub(const LaneVec3& a, const LaneVec3& b)
+	{
+		return { _mm_sub_ps(a.X, b.X), _mm_sub_ps(a.Y, b.Y), _mm_sub_ps(a.Z, b.Z) };
+	}
+
+	// Dot and Cross evaluate in the order glm does, so every lane rounds like a single ray
+	static __m128 Dot(const LaneVec3& a, const LaneVec3& b)
+	{
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.X, b.X), _mm_mul_ps(a.Y, b.Y)), _mm_mul_ps(a.Z, b.Z));
+	}
+
+	static LaneVec3 Cross(const LaneVec3& a, const LaneVec3& b)
+	{
+		return {
+			_mm_sub_ps(_mm_mul_ps(a.Y, b.Z), _mm_mul_ps(b.Y, a.Z)),
+			_mm_sub_ps(_mm_mul_ps(a.Z, b.X), _mm_mul_ps(b.Z, a.X)),
+			_mm_sub_ps(_mm_mul_ps(a.X, b.Y), _mm_mul_ps(b.X, a.Y)) };
+	}
+
+	// IntersectsBox for four lanes sharing an origin, returns one bit per lane
+	static uint32_t IntersectsBoxLanes(const LaneVec3& origin, const LaneVec3& inverseDirection,
+		const LaneVec3& boxMin, const LaneVec3& boxMax, __m128 maxDistance)
+	{
+		LaneVec3 t0 = Sub(boxMin, origin);
+		LaneVec3 t1 = Sub(boxMax, origin);
+		t0 = { _mm_mul_ps(t0.X, inverseDirection.X), _mm_mul_ps(t0.Y, inverseDirection.Y), _mm_mul_ps(t0.Z, inverseDirection.Z) };
+		t1 = { _mm_mul_ps(t1.X, inverseDirection.X), _mm_mul_ps(t1.Y, inverseDirection.Y), _mm_mul_ps(t1.Z, inverseDirection.Z) };
+
+		__m128 entry = _mm_max_ps(
+			_mm_max_ps(_mm_min_ps(t0.X, t1.X), _mm_min_ps(t0.Y, t1.Y)),
+			_mm_max_ps(_mm_min_ps(t0.Z, t1.Z), _mm_setzero_ps()));
+		__m128 exit = _mm_min_ps(
+			_mm_min_ps(_mm_max_ps(t0.X, t1.X), _mm_max_ps(t0.Y, t1.Y)),
+			_mm_max_ps(t0.Z, t1.Z));
+
+		return (uint32_t)_mm_movemask_ps(_mm_and_ps(_mm_cmple_ps(entry, exit), _mm_cmplt_ps(entry, maxDistance)));
+	}
+
+	static bool FrustumCullsTriangle(const glm::vec3* frustumNormals, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			const glm::vec3& normal = frustumNormals[i];
+			if (glm::dot(normal, a) < -FrustumEpsilon && glm::dot(normal, b) < -FrustumEpsilon && glm::dot(normal, c) < -FrustumEpsilon)
+				return true;
+		}
+		return false;
+	}
 }
 
 void Renderer::OnResize(uint32_t width, uint32_t height)
 {
-	if (m_FinalImage)
-	{
-		// No resize necessary
-		if (m_FinalImage->GetWidth() == width && m_FinalImage->GetHeight() == height)
-			return;
+	// No resize necessary
+	if (m_ImageData && m_Width == width && m_Height == height)
+		return;
 
-		m_FinalImage->Resize(width, height);
+	m_Width = width;
+	m_Height = height;
+
+	if (!m_Headless)
+	{
+		if (m_FinalImage)
+			m_FinalImage->Resize(width, height);
+		else
+			m_FinalImage = std::make_shared<Walnut::Image>(width, height, Walnut::ImageFormat::RGBA);
 	}
-	else
+
+	m_Tiles.clear();
+	for (uint32_t y = 0; y < height; y += TileSize)
 	{
-		m_FinalImage = std::make_shared<Walnut::Image>(width, height, Walnut::ImageFormat::RGBA);
+		for (uint32_t x = 0; x < width; x += TileSize)
+			m_Tiles.push_back({ x, y, std::min(x + TileSize, width), std::min(y + TileSize, height) });
 	}
 
+	m_TileFrameIndex.assign(m_Tiles.size(), 1);
+	m_Scheduler.Reset((uint32_t)m_Tiles.size());
+
+	AllocateBuffers();
+}
+
+void Renderer::ConfigureThreads(uint32_t threadCount, const std::vector<uint32_t>& cpus)
+{
+	m_ThreadPool.Configure(threadCount, cpus);
+	m_Scheduler.Reset((uint32_t)m_Tiles.size());
+
+	// Tiles moved to different workers, the buffers are placed again
+	if (m_ImageData)
+		AllocateBuffers();
+}
+
+void Renderer::AllocateBuffers()
+{
 	delete[] m_ImageData;
-	m_ImageData = new uint32_t[width * height];
+	m_ImageData = new uint32_t[m_Width * m_Height];
 
 	delete[] m_AccumulationData;
-	m_AccumulationData = new glm::vec4[width * height];
+	m_AccumulationData = new glm::vec4[m_Width * m_Height];
 
-	m_ImageHorizontalIter.resize(width);
-	m_ImageVerticalIter.resize(height);
+	// Pages are placed on the NUMA node of the thread touching them first,
+	// which should be the worker that renders the tile
+	ClearTiles(true);
 
-	for (uint32_t i = 0; i < width; i++)
-		m_ImageHorizontalIter[i] = i;
+	ResetFrameIndex();
+}
+
+void Renderer::ClearTiles(bool clearImage)
+{
+	m_ThreadPool.ParallelFor(0, (uint32_t)m_Tiles.size(),
+		[this, clearImage](uint32_t tileIndex)
+		{
+			const Tile& tile = m_Tiles[tileIndex];
+			uint32_t width = tile.MaxX - tile.MinX;
 
-	for (uint32_t i = 0; i < height; i++)
-		m_ImageVerticalIter[i] = i;
+			for (uint32_t y = tile.MinY; y < tile.MaxY; y++)
+			{
+				uint32_t rowStart = tile.MinX + y * m_Width;
+				memset(m_AccumulationData + rowStart, 0, width * sizeof(glm::vec4));
+				if (clearImage)
+					memset(m_ImageData + rowStart, 0, width * sizeof(uint32_t));
+			}
+		});
 }
 
 
 void Renderer::Render(const Scene& scene, const Camera& camera)
 {
+	// One integrator variant per feature combination, indexed by the feature mask
+	static constexpr std::array<TileKernel, IntegratorFeatures_Count> kernels =
+		MakeKernelTable(std::make_integer_sequence<uint32_t, IntegratorFeatures_Count>());
+
+	Walnut::Timer timer;
+
 	m_ActiveScene = &scene;
 	m_ActiveCamera = &camera;
 
-	if (m_FrameIndex == 1)
-		memset(m_AccumulationData, 0, m_FinalImage->GetWidth() * m_FinalImage->GetHeight() * sizeof(glm::vec4));
+	// Residency changes requested by the last frame are applied while no tile samples textures
+	scene.Textures->Update();
+
+	uint32_t features = m_Settings.SpecializedKernels ? ResolveFeatures(scene) : IntegratorFeatures_All;
+	if (!m_Settings.PathGuiding)
+		features &= ~IntegratorFeatures_Guiding;
+
+	// Packets only pay off when there is something to shade, termination needs the radiance cache
+	if (m_Settings.PacketTracing && (features & IntegratorFeatures_Emission))
+		features |= IntegratorFeatures_PacketTracing;
+	if (m_Settings.CacheTermination && (features & IntegratorFeatures_Guiding))
+		features |= IntegratorFeatures_CacheTermination;
+
+	if (m_ResetAccumulation)
+	{
+		if (features & IntegratorFeatures_Accumulate)
+			ClearTiles(false);
+
+		std::fill(m_TileFrameIndex.begin(), m_TileFrameIndex.end(), 1);
+		m_ResetAccumulation = false;
+	}
+
+	// Repeating a tile within a frame only pays off when its samples are accumulated
+	float targetFrameTime = m_Settings.FrameBudget ? m_Settings.TargetFrameTime : 0.0f;
+	uint32_t maxSamplesPerTile = m_Settings.Accumulate ? m_Settings.MaxSamplesPerFrame : 1;
+
+	TileKernel kernel = kernels[features];
+	uint64_t samples = 0;
+
+	for (const FrameScheduler::Wave& wave : m_Scheduler.Schedule(targetFrameTime, maxSamplesPerTile))
+	{
+		m_ThreadPool.ParallelFor(wave.Begin, wave.End,
+			[this, kernel](uint32_t tileIndex)
+			{
+				auto start = std::chrono::steady_clock::now();
+				(this->*kernel)(tileIndex);
+				std::chrono::duration<float, std::milli> tileTime = std::chrono::steady_clock::now() - start;
 
+				m_Scheduler.RecordTileTime(tileIndex, tileTime.count());
+			});
 
-	std::for_each(std::execution::par, m_ImageVerticalIter.begin(), m_ImageVerticalIter.end(),
-		[this, scene](uint32_t y)
+		for (uint32_t i = wave.Begin; i < wave.End; i++)
 		{
-			std::for_each(std::execution::par, m_ImageHorizontalIter.begin(), m_ImageHorizontalIter.end(),
-			[this, y, scene](uint32_t x)
+			const Tile& tile = m_Tiles[i];
+			samples += (uint64_t)(tile.MaxX - tile.MinX) * (tile.MaxY - tile.MinY);
+		}
+
+		if (wave.End == (uint32_t)m_Tiles.size() && m_Settings.Accumulate)
+			m_FrameIndex++;
+	}
+
+	// Samples of this frame become visible to the next one
+	if (features & IntegratorFeatures_Guiding)
+		m_RadianceCache.EndFrame();
+
+	if (m_FinalImage)
+		m_FinalImage->SetData(m_ImageData);
+
+	if (!m_Settings.Accumulate)
+		ResetFrameIndex();
+
+	m_Scheduler.EndFrame(timer.ElapsedMillis(), samples);
+}
+
+float Renderer::BenchmarkPrimaryRays(const Scene& scene, const Camera& camera, bool usePackets)
+{
+	m_ActiveScene = &scene;
+	m_ActiveCamera = &camera;
+
+	// Counting hits keeps the traversal from being optimized away
+	std::atomic<uint64_t> hits = 0;
+	uint64_t rays = 0;
+
+	// Repeat whole passes until the measurement is long enough to be stable
+	Walnut::Timer timer;
+	do
+	{
+		m_ThreadPool.ParallelFor(0, (uint32_t)m_Tiles.size(),
+			[this, usePackets, &hits](uint32_t tileIndex)
+			{
+				const Tile& tile = m_Tiles[tileIndex];
+				uint64_t tileHits = 0;
+
+				if (usePackets)
 				{
-					glm::vec4 color;
-					color = PerPixel(x, y);
+					RayPacket packet;
+					HitPayload payloads[RayPacket::Size];
+
+					for (uint32_t blockY = tile.MinY; blockY < tile.MaxY; blockY += RayPacket::Width)
+					{
+						for (uint32_t blockX = tile.MinX; blockX < tile.MaxX; blockX += RayPacket::Width)
+						{
+							GeneratePacket(blockX, blockY, std::min(blockX + RayPacket::Width, tile.MaxX), std::min(blockY + RayPacket::Width, tile.MaxY), packet);
+							TracePacket(m_ActiveScene, packet, payloads);
+
+							for (uint32_t lane = 0; lane < RayPacket::Size; lane++)
+								tileHits += ((packet.ActiveMask >> lane) & 1) && payloads[lane].HitDistance >= 0.0f;
+						}
+					}
+				}
+				else
+				{
+					Ray ray;
+					ray.Origin = m_ActiveCamera->GetPosition();
+
+					for (uint32_t y = tile.MinY; y < tile.MaxY; y++)
+					{
+						for (uint32_t x = tile.MinX; x < tile.MaxX; x++)
+						{
+							ray.Direction = m_ActiveCamera->GetRayDirections()[x + y * m_Width];
+							tileHits += TraceRay(m_ActiveScene, ray).HitDistance >= 0.0f;
+						}
+					}
+				}
+
+				hits += tileHits;
+			});
+
+		rays += (uint64_t)m_Width * m_Height;
+	} while (timer.Elapsed() < 0.25f);
+
+	return (float)((double)rays / timer.Elapsed());
+}
 
-					m_AccumulationData[x + y * m_FinalImage->GetWidth()] += color;
+float Renderer::BenchmarkThreads(const Scene& scene, const Camera& camera, uint32_t threadCount, uint32_t frames)
+{
+	Settings previousSettings = m_Settings;
 
-					glm::vec4 accumulatedColor = m_AccumulationData[x + y * m_FinalImage->GetWidth()];
-					accumulatedColor /= (float)m_FrameIndex;
+	// Full passes only, a frame budget would hide the difference between thread counts
+	m_Settings.Accumulate = true;
+	m_Settings.FrameBudget = false;
+	if (threadCount != m_ThreadPool.GetWorkerCount())
+		ConfigureThreads(threadCount, m_ThreadPool.GetCpus());
 
-					accumulatedColor = glm::clamp(accumulatedColor, glm::vec4(0.0f), glm::vec4(1.0f));
-					m_ImageData[x + y * m_FinalImage->GetWidth()] = Helpers::ConvertToABGR(accumulatedColor);
-				});
-		});
+	// The first frame measures tile costs and warms up caches, it is not counted
+	ResetFrameIndex();
+	Render(scene, camera);
+
+	Walnut::Timer timer;
+	for (uint32_t i = 0; i < frames; i++)
+		Render(scene, camera);
+	float frameTime = timer.ElapsedMillis() / (float)frames;
+
+	m_Settings = previousSettings;
+	ResetFrameIndex();
+
+	return frameTime;
+}
+
+void Renderer::CaptureCheckpoint(Checkpoint& checkpoint) const
+{
+	checkpoint.Width = m_Width;
+	checkpoint.Height = m_Height;
+	checkpoint.FrameIndex = m_FrameIndex;
+	checkpoint.SchedulerCursor = m_Scheduler.GetCursor();
+	checkpoint.TileFrameIndex = m_TileFrameIndex;
+
+	checkpoint.AccumulationData.resize((size_t)m_Width * m_Height);
+	for (size_t i = 0; i < checkpoint.AccumulationData.size(); i++)
+		checkpoint.AccumulationData[i] = glm::vec3(m_AccumulationData[i]);
+}
+
+bool Renderer::RestoreCheckpoint(const Checkpoint& checkpoint)
+{
+	if (!m_ImageData || checkpoint.Width != m_Width || checkpoint.Height != m_Height)
+		return false;
+
+	if (checkpoint.TileFrameIndex.size() != m_Tiles.size() || checkpoint.AccumulationData.size() != (size_t)checkpoint.Width * checkpoint.Height)
+		return false;
 
-	m_FinalImage->SetData(m_ImageData);
+	m_TileFrameIndex = checkpoint.TileFrameIndex;
+	m_FrameIndex = checkpoint.FrameIndex;
+	m_Scheduler.SetCursor(checkpoint.SchedulerCursor);
+
+	// Every accumulated sample added 1 to alpha. The image is resolved as RenderPixel does,
+	// so tiles the scheduler has not reached again do not stay black.
+	for (uint32_t tileIndex = 0; tileIndex < (uint32_t)m_Tiles.size(); tileIndex++)
+	{
+		const Tile& tile = m_Tiles[tileIndex];
+		float samples = (float)(m_TileFrameIndex[tileIndex] - 1);
+
+		for (uint32_t y = tile.MinY; y < tile.MaxY; y++)
+		{
+			for (uint32_t x = tile.MinX; x < tile.MaxX; x++)
+			{
+				uint32_t pixelIndex = x + y * checkpoint.Width;
+				m_AccumulationData[pixelIndex] = glm::vec4(checkpoint.AccumulationData[pixelIndex], samples);
+
+				glm::vec4 color = samples > 0.0f ? m_AccumulationData[pixelIndex] / samples : glm::vec4(0.0f);
+				color = glm::clamp(color, glm::vec4(0.0f), glm::vec4(1.0f));
+				m_ImageData[pixelIndex] = Helpers::ConvertToABGR(color);
+			}
+		}
+	}
+
+	if (m_FinalImage)
+		m_FinalImage->SetData(m_ImageData);
+
+	m_ResetAccumulation = false;
+	return true;
+}
+
+uint32_t Renderer::ResolveFeatures(const Scene& scene) const
+{
+	uint32_t features = IntegratorFeatures_None;
 
 	if (m_Settings.Accumulate)
-		m_FrameIndex++;
+		features |= IntegratorFeatures_Accumulate;
+
+	// Only materials that are actually referenced can contribute to the image
+	for (const Model* model : scene.Models)
+	{
+		const Material& material = scene.Materials[model->m_materialIndex];
+		if (material.EmissionPower > 0.0f && material.EmissionColor != glm::vec3(0.0f))
+			features |= IntegratorFeatures_Emission;
+		if (material.Metallic > 0.0f)
+			features |= IntegratorFeatures_Metallic;
+	}
+
+	// Guiding only moves light around, without emission there is nothing to guide towards
+	if (m_Settings.PathGuiding && (features & IntegratorFeatures_Emission))
+		features |= IntegratorFeatures_Guiding;
+
+	return features;
+}
+
+template<uint32_t Features>
+void Renderer::RenderTile(uint32_t tileIndex)
+{
+	const Tile& tile = m_Tiles[tileIndex];
+	uint32_t frameIndex = m_TileFrameIndex[tileIndex];
+
+	// Primary rays of a block are coherent and traced together, the diverging bounces use single rays
+	if constexpr ((Features & IntegratorFeatures_PacketTracing) != 0)
+	{
+		RayPacket packet;
+		HitPayload primaryHits[RayPacket::Size];
+
+		for (uint32_t blockY = tile.MinY; blockY < tile.MaxY; blockY += RayPacket::Width)
+		{
+			for (uint32_t blockX = tile.MinX; blockX < tile.MaxX; blockX += RayPacket::Width)
+			{
+				uint32_t maxX = std::min(blockX + RayPacket::Width, tile.MaxX);
+				uint32_t maxY = std::min(blockY + RayPacket::Width, tile.MaxY);
+
+				GeneratePacket(blockX, blockY, maxX, maxY, packet);
+				TracePacket(m_ActiveScene, packet, primaryHits);
+
+				for (uint32_t y = blockY; y < maxY; y++)
+				{
+					for (uint32_t x = blockX; x < maxX; x++)
+						RenderPixel<Features>(x, y, frameIndex, &primaryHits[(x - blockX) + (y - blockY) * RayPacket::Width]);
+				}
+			}
+		}
+	}
 	else
-		m_FrameIndex = 1;
+	{
+		for (uint32_t y = tile.MinY; y < tile.MaxY; y++)
+		{
+			for (uint32_t x = tile.MinX; x < tile.MaxX; x++)
+				RenderPixel<Features>(x, y, frameIndex, nullptr);
+		}
+	}
+
+	if constexpr ((Features & IntegratorFeatures_Accumulate) != 0)
+		m_TileFrameIndex[tileIndex]++;
+}
+
+template<uint32_t Features>
+void Renderer::RenderPixel(uint32_t x, uint32_t y, uint32_t frameIndex, const HitPayload* primaryHit)
+{
+	uint32_t pixelIndex = x + y * m_Width;
+	glm::vec4 color = PerPixel<Features>(x, y, frameIndex, primaryHit);
+
+	if constexpr ((Features & IntegratorFeatures_Accumulate) != 0)
+	{
+		m_AccumulationData[pixelIndex] += color;
+
+		color = m_AccumulationData[pixelIndex];
+		color /= (float)frameIndex;
+	}
+
+	color = glm::clamp(color, glm::vec4(0.0f), glm::vec4(1.0f));
+	m_ImageData[pixelIndex] = Helpers::ConvertToABGR(color);
 }
 
-glm::vec4 Renderer::PerPixel(uint32_t x, uint32_t y)
+template<uint32_t Features>
+glm::vec4 Renderer::PerPixel(uint32_t x, uint32_t y, uint32_t frameIndex, const HitPayload* primaryHit)
 {
+	// Light is only ever gathered from emissive surfaces, without them every path is black
+	if constexpr ((Features & IntegratorFeatures_Emission) == 0)
+		return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
 	Ray ray;
 	ray.Origin = m_ActiveCamera->GetPosition();
-	ray.Direction = m_ActiveCamera->GetRayDirections()[x + y * m_FinalImage->GetWidth()];
+	ray.Direction = m_ActiveCamera->GetRayDirections()[x + y * m_Width];
 
 	glm::vec3 light = glm::vec3(0.0f);
-	glm::vec3 lightContribution(1.0f);
 
-	uint32_t seed = x + y * m_FinalImage->GetWidth();
-	seed *= m_FrameIndex;
+	uint32_t seed = x + y * m_Width;
+	seed *= frameIndex;
 
-	int bounces = 5;
-	for (int i = 0; i < bounces; i++)
+	// Ray cone for texture filtering, starting at the camera with the footprint of one pixel
+	float coneWidth = 0.0f;
+	float coneSpread = m_ActiveCamera->GetPixelSpreadAngle();
+
+	// Guided bounces are weighted by material pdf over sampling pdf, so the expected light stays
+	// that of sampling the material alone. Every bounce is remembered to train the radiance cache.
+	struct GuideVertex
+	{
+		int32_t Cell;
+		uint32_t Bin;
+		glm::vec3 Light;
+		float Weight;
+		float DiffuseWeight;
+	};
+	GuideVertex guideVertices[Bounces];
+	uint32_t guideVertexCount = 0;
+	float guideWeight = 1.0f;
+
+	for (int i = 0; i < Bounces; i++)
 	{
 		seed += i;
 
-		Renderer::HitPayload payload = TraceRay(m_ActiveScene, ray);
+		Renderer::HitPayload payload = (i == 0 && primaryHit) ? *primaryHit : TraceRay(m_ActiveScene, ray);
 		if (payload.HitDistance < 0.0f)
 		{
 			break;
@@ -133,12 +608,126 @@ glm::vec4 Renderer::PerPixel(uint32_t x, uint32_t y)
 		const Model* model = payload.Model;
 		const Material& material = m_ActiveScene->Materials[model->m_materialIndex];
 
-		lightContribution *= material.Albedo;
-		light += material.GetEmission();
+		coneWidth += coneSpread * payload.HitDistance;
+
+		// Only emission reaches the image, a texture on a surface that does not emit is not fetched
+		glm::vec3 emission = material.GetEmission();
+		if (material.TextureIndex >= 0 && emission != glm::vec3(0.0f))
+		{
+			const Triangle& triangle = *payload.Triangle;
+			const TextureCache& textures = *m_ActiveScene->Textures;
+			const Texture& texture = textures.GetTexture(material.TextureIndex);
+
+			// Texels covered by the cone footprint, projected onto the surface
+			float cosine = std::abs(glm::dot(triangle.Normal, ray.Direction));
+			float lod = triangle.TextureLod + 0.5f * std::log2((float)texture.GetWidth() * texture.GetHeight()) + std::log2(coneWidth / cosine);
+
+			emission *= textures.Sample(material.TextureIndex, Helpers::InterpolateUV(triangle, payload.WorldPosition - model->Position), lod);
+		}
+
+		light += emission * guideWeight;
+
+		// Rough bounces widen the cone, later hits then read coarse mip levels
+		coneSpread += material.Roughness * Helpers::RoughConeSpread;
+
+		// The last bounce does not need a continuation ray
+		if (i == Bounces - 1)
+			break;
 
 		ray.Origin = payload.WorldPosition + payload.WorldNormal * 0.0001f;
 
-		ray.Direction = glm::normalize(payload.WorldNormal + material.Roughness * Helpers::InUnitSphere(seed));
+		bool diffuse = true;
+		if constexpr ((Features & IntegratorFeatures_Metallic) != 0)
+		{
+			// Metallic picks between a glossy reflection and the diffuse lobe
+			if (Helpers::RandomFloatPcg(seed) < material.Metallic)
+			{
+				ray.Direction = glm::normalize(glm::reflect(ray.Direction, payload.WorldNormal) + material.Roughness * Helpers::InUnitSphere(seed));
+				diffuse = false;
+			}
+		}
+
+		// Cells are only taken for bounces that can be guided, the table has a fixed capacity
+		int32_t cell = -1;
+		bool guidable = false;
+		if constexpr ((Features & IntegratorFeatures_Guiding) != 0)
+		{
+			if (diffuse && material.Roughness >= GuideMinRoughness)
+			{
+				cell = m_RadianceCache.FindOrInsertCell(payload.WorldPosition, payload.WorldNormal);
+				guidable = cell >= 0 && m_RadianceCache.IsTrained(cell);
+			}
+		}
+
+		if constexpr ((Features & IntegratorFeatures_CacheTermination) != 0)
+		{
+			if (guidable && i >= 1 && material.Metallic == 0.0f)
+			{
+				light += m_RadianceCache.GetDiffuseRadiance(cell) * guideWeight;
+				break;
+			}
+		}
+
+		// The diffuse lobe uses a uniform sphere in every kernel, guided bounces need its exact pdf
+		// and guided and unguided renders have to converge to the same image
+		if constexpr ((Features & IntegratorFeatures_Guiding) == 0)
+		{
+			if (diffuse)
+				ray.Direction = glm::normalize(payload.WorldNormal + material.Roughness * Helpers::OnUnitSphere(seed));
+		}
+		else
+		{
+			float bounceWeight = 1.0f;
+			float diffuseWeight = 0.0f;
+
+			if (diffuse)
+			{
+				bool guided = guidable && Helpers::RandomFloatPcg(seed) < m_Settings.GuideFraction;
+				if (guided)
+				{
+					float u0 = Helpers::RandomFloatPcg(seed);
+					float u1 = Helpers::RandomFloatPcg(seed);
+					float u2 = Helpers::RandomFloatPcg(seed);
+					ray.Direction = m_RadianceCache.SampleDirection(cell, payload.WorldNormal, u0, u1, u2);
+				}
+				else
+				{
+					ray.Direction = glm::normalize(payload.WorldNormal + material.Roughness * Helpers::OnUnitSphere(seed));
+				}
+
+				float cosine = glm::dot(ray.Direction, payload.WorldNormal);
+				float materialPdf = Helpers::DiffuseLobePdf(cosine, material.Roughness);
+				float samplingPdf = materialPdf;
+				if (guidable)
+				{
+					float guidePdf = m_RadianceCache.GetPdf(cell, RadianceCache::GetBin(payload.WorldNormal, ray.Direction));
+					samplingPdf = m_Settings.GuideFraction * guidePdf + (1.0f - m_Settings.GuideFraction) * materialPdf;
+					bounceWeight = materialPdf / samplingPdf;
+				}
+
+				// Lets the cache average over the cosine lobe whatever the direction was sampled from
+				if (samplingPdf > 0.0f)
+					diffuseWeight = glm::max(cosine, 0.0f) / Helpers::Pi / samplingPdf;
+			}
+
+			// Guided directions outside the material lobe carry no light
+			guideWeight *= bounceWeight;
+			if (guideWeight == 0.0f)
+				break;
+
+			if (cell >= 0)
+				guideVertices[guideVertexCount++] = { cell, RadianceCache::GetBin(payload.WorldNormal, ray.Direction), light, guideWeight, diffuseWeight };
+		}
+	}
+
+	// Everything gathered after a bounce, without the weights up to it, is the light arriving from its direction
+	if constexpr ((Features & IntegratorFeatures_Guiding) != 0)
+	{
+		for (uint32_t i = 0; i < guideVertexCount; i++)
+		{
+			const GuideVertex& vertex = guideVertices[i];
+			m_RadianceCache.AddSample(vertex.Cell, vertex.Bin, (light - vertex.Light) / vertex.Weight, vertex.DiffuseWeight);
+		}
 	}
 
 	return glm::vec4(light, 1.0f);
@@ -155,9 +744,13 @@ Renderer::HitPayload Renderer::TraceRay(const Scene* scene, const Ray& ray) {
 
 
 	for (const Model* model : scene->Models) {
+		Ray localRay = { ray.Origin - model->Position, ray.Direction };
+		if (!Helpers::IntersectsBox(localRay, model->m_boundsMin, model->m_boundsMax, hitDistance))
+			continue;
+
 		for (const Triangle* triangle : model->m_triangles)
 		{
-			glm::vec3 origin = ray.Origin - model->Position;
+			glm::vec3 origin = localRay.Origin;
 			float t = (glm::dot(triangle->Normal, triangle->A - origin)) / glm::dot(triangle->Normal, ray.Direction);
 			glm::vec3 Q = origin + t * ray.Direction;
 
@@ -179,12 +772,186 @@ Renderer::HitPayload Renderer::TraceRay(const Scene* scene, const Ray& ray) {
 	if (closestTriangle == nullptr)
 		return Miss(ray);
 
-	glm::vec3 lightDir = glm::normalize(glm::vec3(-0.8, -0.7, -0.9));
-	float lightIntensity = glm::dot(closestTriangle->Normal, -lightDir);
-
 	return ClosestHit(ray, hitDistance, closestModel, closestTriangle);
 }
 
+void Renderer::GeneratePacket(uint32_t minX, uint32_t minY, uint32_t maxX, uint32_t maxY, RayPacket& packet) const
+{
+	const std::vector<glm::vec3>& rayDirections = m_ActiveCamera->GetRayDirections();
+
+	packet.Origin = m_ActiveCamera->GetPosition();
+	packet.ActiveMask = 0;
+
+	for (uint32_t y = 0; y < RayPacket::Width; y++)
+	{
+		for (uint32_t x = 0; x < RayPacket::Width; x++)
+		{
+			uint32_t lane = x + y * RayPacket::Width;
+			if (minX + x < maxX && minY + y < maxY)
+				packet.ActiveMask |= 1ull << lane;
+
+			// Inactive lanes repeat an edge ray so they stay inside the frustum
+			uint32_t pixelX = std::min(minX + x, maxX - 1);
+			uint32_t pixelY = std::min(minY + y, maxY - 1);
+			const glm::vec3& direction = rayDirections[pixelX + pixelY * m_Width];
+
+			packet.DirectionX[lane] = direction.x;
+			packet.DirectionY[lane] = direction.y;
+			packet.DirectionZ[lane] = direction.z;
+		}
+	}
+
+	// The directions of a rectangular block of pixels lie within the cone spanned by its corner rays
+	glm::vec3 corners[4] =
+	{
+		rayDirections[minX + minY * m_Width],
+		rayDirections[(maxX - 1) + minY * m_Width],
+		rayDirections[(maxX - 1) + (maxY - 1) * m_Width],
+		rayDirections[minX + (maxY - 1) * m_Width],
+	};
+	glm::vec3 center = corners[0] + corners[1] + corners[2] + corners[3];
+
+	for (int i = 0; i < 4; i++)
+	{
+		glm::vec3 normal = glm::cross(corners[i], corners[(i + 1) % 4]);
+		float length = glm::length(normal);
+
+		// Blocks one pixel wide have coinciding corners, the plane is left out
+		if (length < 1e-8f)
+		{
+			packet.FrustumNormals[i] = glm::vec3(0.0f);
+			continue;
+		}
+
+		normal /= length;
+		packet.FrustumNormals[i] = glm::dot(normal, center) < 0.0f ? -normal : normal;
+	}
+}
+
+void Renderer::TracePacket(const Scene* scene, const RayPacket& packet, HitPayload* payloads)
+{
+	// Lanes are processed in groups of four, one SSE register each
+	constexpr uint32_t GroupCount = RayPacket::Size / 4;
+
+	alignas(16) float hitDistance[RayPacket::Size];
+	alignas(16) float inverseX[RayPacket::Size];
+	alignas(16) float inverseY[RayPacket::Size];
+	alignas(16) float inverseZ[RayPacket::Size];
+	const Triangle* closestTriangle[RayPacket::Size] = {};
+	const Model* closestModel[RayPacket::Size] = {};
+
+	for (uint32_t lane = 0; lane < RayPacket::Size; lane++)
+	{
+		hitDistance[lane] = std::numeric_limits<float>::max();
+		inverseX[lane] = 1.0f / packet.DirectionX[lane];
+		inverseY[lane] = 1.0f / packet.DirectionY[lane];
+		inverseZ[lane] = 1.0f / packet.DirectionZ[lane];
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+
+	for (const Model* model : scene->Models)
+	{
+		// Geometry is moved relative to the packet origin, which is the apex of the frustum
+		glm::vec3 origin = packet.Origin - model->Position;
+		if (Helpers::FrustumCullsBox(packet.FrustumNormals, model->m_boundsMin - origin, model->m_boundsMax - origin))
+			continue;
+
+		Helpers::LaneVec3 laneOrigin = Helpers::Splat(origin);
+		Helpers::LaneVec3 boxMin = Helpers::Splat(model->m_boundsMin);
+		Helpers::LaneVec3 boxMax = Helpers::Splat(model->m_boundsMax);
+
+		// Active lanes that enter the bounds before their closest hit so far, no other lane can hit this model
+		uint64_t modelMask = 0;
+		for (uint32_t group = 0; group < GroupCount; group++)
+		{
+			uint32_t offset = group * 4;
+			if (((packet.ActiveMask >> offset) & 0xf) == 0)
+				continue;
+
+			Helpers::LaneVec3 inverseDirection = { _mm_load_ps(inverseX + offset), _mm_load_ps(inverseY + offset), _mm_load_ps(inverseZ + offset) };
+			uint32_t lanes = Helpers::IntersectsBoxLanes(laneOrigin, inverseDirection, boxMin, boxMax, _mm_load_ps(hitDistance + offset));
+			modelMask |= (uint64_t)lanes << offset;
+		}
+
+		modelMask &= packet.ActiveMask;
+		if (modelMask == 0)
+			continue;
+
+		for (const Triangle* triangle : model->m_triangles)
+		{
+			glm::vec3 a = triangle->A - origin;
+			glm::vec3 b = triangle->B - origin;
+			glm::vec3 c = triangle->C - origin;
+			if (Helpers::FrustumCullsTriangle(packet.FrustumNormals, a, b, c))
+				continue;
+
+			// Same expressions as TraceRay, so both paths make the same hit decisions for a triangle
+			Helpers::LaneVec3 normal = Helpers::Splat(triangle->Normal);
+			__m128 planeDistance = _mm_set1_ps(glm::dot(triangle->Normal, a));
+
+			Helpers::LaneVec3 vertexA = Helpers::Splat(triangle->A);
+			Helpers::LaneVec3 vertexB = Helpers::Splat(triangle->B);
+			Helpers::LaneVec3 vertexC = Helpers::Splat(triangle->C);
+			Helpers::LaneVec3 edgeAB = Helpers::Splat(triangle->B - triangle->A);
+			Helpers::LaneVec3 edgeBC = Helpers::Splat(triangle->C - triangle->B);
+			Helpers::LaneVec3 edgeCA = Helpers::Splat(triangle->A - triangle->C);
+
+			for (uint32_t group = 0; group < GroupCount; group++)
+			{
+				uint32_t offset = group * 4;
+				uint32_t groupMask = (uint32_t)(modelMask >> offset) & 0xf;
+				if (groupMask == 0)
+					continue;
+
+				Helpers::LaneVec3 direction = { _mm_load_ps(packet.DirectionX + offset), _mm_load_ps(packet.DirectionY + offset), _mm_load_ps(packet.DirectionZ + offset) };
+
+				__m128 t = _mm_div_ps(planeDistance, Helpers::Dot(normal, direction));
+				Helpers::LaneVec3 Q =
+				{
+					_mm_add_ps(laneOrigin.X, _mm_mul_ps(t, direction.X)),
+					_mm_add_ps(laneOrigin.Y, _mm_mul_ps(t, direction.Y)),
+					_mm_add_ps(laneOrigin.Z, _mm_mul_ps(t, direction.Z)),
+				};
+
+				__m128 hit = _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, _mm_load_ps(hitDistance + offset)));
+				hit = _mm_and_ps(hit, _mm_cmpge_ps(Helpers::Dot(Helpers::Cross(edgeAB, Helpers::Sub(Q, vertexA)), normal), zero));
+				hit = _mm_and_ps(hit, _mm_cmpge_ps(Helpers::Dot(Helpers::Cross(edgeBC, Helpers::Sub(Q, vertexB)), normal), zero));
+				hit = _mm_and_ps(hit, _mm_cmpge_ps(Helpers::Dot(Helpers::Cross(edgeCA, Helpers::Sub(Q, vertexC)), normal), zero));
+
+				uint32_t hits = (uint32_t)_mm_movemask_ps(hit) & groupMask;
+				if (hits == 0)
+					continue;
+
+				alignas(16) float distances[4];
+				_mm_store_ps(distances, t);
+
+				for (uint32_t i = 0; i < 4; i++)
+				{
+					if ((hits >> i) & 1)
+					{
+						hitDistance[offset + i] = distances[i];
+						closestTriangle[offset + i] = triangle;
+						closestModel[offset + i] = model;
+					}
+				}
+			}
+		}
+	}
+
+	for (uint32_t lane = 0; lane < RayPacket::Size; lane++)
+	{
+		Ray ray;
+		ray.Origin = packet.Origin;
+		ray.Direction = glm::vec3(packet.DirectionX[lane], packet.DirectionY[lane], packet.DirectionZ[lane]);
+
+		if (closestTriangle[lane] == nullptr)
+			payloads[lane] = Miss(ray);
+		else
+			payloads[lane] = ClosestHit(ray, hitDistance[lane], closestModel[lane], closestTriangle[lane]);
+	}
+}
+
 Renderer::HitPayload Renderer::ClosestHit(const Ray& ray, float hitDistance, const Model* model, const Triangle* triangle)
 {
 	Renderer::HitPayload payload;
@@ -1,10 +1,17 @@
 #pragma once
 
 #include "Walnut/Image.h"
+#include <array>
 #include <memory>
+#include <utility>
 #include "Camera.h"
 #include "Ray.h"
 #include "Scene.h"
+#include "FrameScheduler.h"
+#include "ThreadPool.h"
+#include "RadianceCache.h"
+
+struct Checkpoint;
 
 class Renderer 
 {
@@ -12,17 +19,57 @@ public:
 	struct Settings
 	{
 		bool Accumulate = true;
+		bool SpecializedKernels = true;
+
+		// Renders only as many tiles per frame as fit into the target frame time (ms)
+		bool FrameBudget = true;
+		float TargetFrameTime = 16.0f;
+		uint32_t MaxSamplesPerFrame = 16;
+
+		bool PacketTracing = true;
+
+		// Samples rough bounces partly from the radiance cache, converges to the same image as without it
+		bool PathGuiding = false;
+		// Probability of taking a guided direction at a guided bounce
+		float GuideFraction = 0.5f;
+		// Ends diffuse paths with the cached radiance after the first bounce, faster but biased
+		bool CacheTermination = false;
 	};
 
 	Renderer() = default;
+	// Headless renderers keep their result in CPU memory only, they can render from any thread
+	explicit Renderer(bool headless) : m_Headless(headless) {}
 
 	void OnResize(uint32_t width, uint32_t height);
 	void Render(const Scene& scene, const Camera& camera);
 
 	std::shared_ptr<Walnut::Image> GetFinalImage() const { return m_FinalImage; };
+	const uint32_t* GetImageData() const { return m_ImageData; }
+	uint32_t GetWidth() const { return m_Width; }
+	uint32_t GetHeight() const { return m_Height; }
 
-	void ResetFrameIndex() { m_FrameIndex = 1; }
+	void ResetFrameIndex() { m_FrameIndex = 1; m_ResetAccumulation = true; }
 	Settings& GetSettings() { return m_Settings; }
+
+	uint32_t GetFrameIndex() const { return m_FrameIndex; }
+	const FrameScheduler& GetScheduler() const { return m_Scheduler; }
+
+	// Worker threads render the tiles, a thread count of 0 uses every hardware thread (or every listed CPU)
+	void ConfigureThreads(uint32_t threadCount, const std::vector<uint32_t>& cpus = {});
+	const ThreadPool& GetThreadPool() const { return m_ThreadPool; }
+
+	RadianceCache& GetRadianceCache() { return m_RadianceCache; }
+
+	// Average time of full passes rendered with the given thread count. The workers are only reconfigured
+	// when the count changes and are left that way, so a sweep places the buffers once per step.
+	float BenchmarkThreads(const Scene& scene, const Camera& camera, uint32_t threadCount, uint32_t frames);
+
+	// Traces every primary ray of the camera without shading, returns rays per second
+	float BenchmarkPrimaryRays(const Scene& scene, const Camera& camera, bool usePackets);
+
+	// Restoring requires the renderer to be resized to the checkpoint resolution first
+	void CaptureCheckpoint(Checkpoint& checkpoint) const;
+	bool RestoreCheckpoint(const Checkpoint& checkpoint);
 private:
 	struct HitPayload
 	{
@@ -34,16 +81,72 @@ private:
 		const Triangle* Triangle;
 	};
 
-	glm::vec4 Renderer::PerPixel(uint32_t x, uint32_t y);
+	// Features an integrator variant is compiled with, combined as a bit mask
+	enum IntegratorFeatures : uint32_t
+	{
+		IntegratorFeatures_None = 0,
+		IntegratorFeatures_Emission = 1 << 0,
+		IntegratorFeatures_Metallic = 1 << 1,
+		IntegratorFeatures_Accumulate = 1 << 2,
+		IntegratorFeatures_Guiding = 1 << 3,
+		// Modes picked by the settings, they are compiled in even when the generic kernel is used
+		IntegratorFeatures_PacketTracing = 1 << 4,
+		IntegratorFeatures_CacheTermination = 1 << 5,
+
+		IntegratorFeatures_All = IntegratorFeatures_Emission | IntegratorFeatures_Metallic | IntegratorFeatures_Accumulate | IntegratorFeatures_Guiding,
+		IntegratorFeatures_Count = 1 << 6
+	};
+
+	using TileKernel = void (Renderer::*)(uint32_t);
+
+	struct Tile
+	{
+		uint32_t MinX, MinY;
+		uint32_t MaxX, MaxY;
+	};
+
+	static constexpr int Bounces = 5;
+	static constexpr uint32_t TileSize = 32;
+	// Smoother surfaces keep sampling their own lobe, it is too narrow for the cache bins
+	static constexpr float GuideMinRoughness = 0.5f;
+
+	uint32_t ResolveFeatures(const Scene& scene) const;
+	void AllocateBuffers();
+	void ClearTiles(bool clearImage);
+
+	template<uint32_t... Features>
+	static constexpr std::array<TileKernel, sizeof...(Features)> MakeKernelTable(std::integer_sequence<uint32_t, Features...>)
+	{
+		return { &Renderer::RenderTile<Features>... };
+	}
+
+	template<uint32_t Features>
+	void RenderTile(uint32_t tileIndex);
+
+	template<uint32_t Features>
+	void RenderPixel(uint32_t x, uint32_t y, uint32_t frameIndex, const HitPayload* primaryHit);
+
+	template<uint32_t Features>
+	glm::vec4 PerPixel(uint32_t x, uint32_t y, uint32_t frameIndex, const HitPayload* primaryHit);
+
+	void GeneratePacket(uint32_t minX, uint32_t minY, uint32_t maxX, uint32_t maxY, RayPacket& packet) const;
+	void TracePacket(const Scene* scene, const RayPacket& packet, HitPayload* payloads);
 
 	Renderer::HitPayload TraceRay(const Scene* scene, const Ray& ray);
 	HitPayload ClosestHit(const Ray& ray, float hitDistance, const  Model* model, const Triangle* triangle);
 	HitPayload Miss(const Ray& ray);
 
 	std::shared_ptr<Walnut::Image> m_FinalImage;
+	bool m_Headless = false;
+	uint32_t m_Width = 0, m_Height = 0;
 	Settings m_Settings;
 
-	std::vector<uint32_t> m_ImageHorizontalIter, m_ImageVerticalIter;
+	std::vector<Tile> m_Tiles;
+	// Index of the next sample of every tile, tiles progress independently under a frame budget
+	std::vector<uint32_t> m_TileFrameIndex;
+	FrameScheduler m_Scheduler;
+	ThreadPool m_ThreadPool;
+	RadianceCache m_RadianceCache;
 
 	const Scene* m_ActiveScene = nullptr;
 	const Camera* m_ActiveCamera = nullptr;
@@ -51,5 +154,7 @@ private:
 	uint32_t* m_ImageData = nullptr;
 	glm::vec4* m_AccumulationData = nullptr;
 
+	// Number of completed passes over the whole image, plus one
 	uint32_t m_FrameIndex = 1;
-};
\ No newline at end of file
+	bool m_ResetAccumulation = true;
+};
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <memory>
 #include <vector>
 #include "Model.h"
+#include "Texture.h"
 
 struct Material
 {
@@ -11,6 +13,8 @@ struct Material
 	float Metallic = 0.0f;
 	glm::vec3 EmissionColor{ 0.0f };
 	float EmissionPower = 0.0f;
+	// Index into the scene's texture cache, -1 for none. The texture tints the emission.
+	int TextureIndex = -1;
 
 	glm::vec3 GetEmission() const { return EmissionColor * EmissionPower; }
 };
@@ -21,4 +25,6 @@ struct Scene
 	std::vector<Material> Materials;
 	std::vector<Triangle> Triangles;
 	std::vector<Model*> Models;
+	// Updated by the renderer before every frame, a scene rendered on another thread needs its own cache
+	std::shared_ptr<TextureCache> Textures = std::make_shared<TextureCache>();
 };
\ No newline at end of file
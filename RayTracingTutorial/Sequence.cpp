@@ -0,0 +1,268 @@
+#include "Sequence.h"
+
+#include "Walnut/Timer.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <sstream>
+
+FrameWriter::FrameWriter()
+{
+	m_Worker = std::thread(&FrameWriter::WorkerLoop, this);
+}
+
+FrameWriter::~FrameWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stop = true;
+	}
+	m_JobAdded.notify_one();
+	m_Worker.join();
+}
+
+void FrameWriter::Submit(const std::string& filepath, uint32_t width, uint32_t height, std::vector<uint32_t>&& pixels)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Jobs.push_back({ filepath, width, height, std::move(pixels) });
+	}
+	m_JobAdded.notify_one();
+}
+
+void FrameWriter::Flush()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_JobDone.wait(lock, [this]() { return m_Jobs.empty() && !m_Writing; });
+}
+
+void FrameWriter::WorkerLoop()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	while (true)
+	{
+		m_JobAdded.wait(lock, [this]() { return m_Stop || !m_Jobs.empty(); });
+
+		// Pending frames are still written when stopping
+		if (m_Jobs.empty())
+			return;
+
+		Job job = std::move(m_Jobs.front());
+		m_Jobs.pop_front();
+		m_Writing = true;
+
+		lock.unlock();
+		if (!WritePPM(job))
+			std::cout << "could not write frame " << job.Filepath << std::endl;
+		lock.lock();
+
+		m_Writing = false;
+		m_JobDone.notify_all();
+	}
+}
+
+bool FrameWriter::WritePPM(const Job& job)
+{
+	std::vector<uint8_t> rgb((size_t)job.Width * job.Height * 3);
+
+	// The image is stored bottom row first, PPM expects the top row first
+	for (uint32_t y = 0; y < job.Height; y++)
+	{
+		const uint32_t* source = job.Pixels.data() + (size_t)(job.Height - 1 - y) * job.Width;
+		uint8_t* destination = rgb.data() + (size_t)y * job.Width * 3;
+
+		for (uint32_t x = 0; x < job.Width; x++)
+		{
+			destination[x * 3 + 0] = (uint8_t)(source[x] & 0xff);
+			destination[x * 3 + 1] = (uint8_t)((source[x] >> 8) & 0xff);
+			destination[x * 3 + 2] = (uint8_t)((source[x] >> 16) & 0xff);
+		}
+	}
+
+	std::ofstream file(job.Filepath, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	file << "P6\n" << job.Width << " " << job.Height << "\n255\n";
+	file.write((const char*)rgb.data(), rgb.size());
+
+	return file.good();
+}
+
+SequenceRenderer::SequenceRenderer(float verticalFOV, float nearClip, float farClip)
+	: m_Cameras{ Camera(verticalFOV, nearClip, farClip), Camera(verticalFOV, nearClip, farClip) }
+{
+	// Every frame is rendered to completion, one full pass per Render call
+	Renderer::Settings& settings = m_Renderer.GetSettings();
+	settings.Accumulate = true;
+	settings.FrameBudget = false;
+}
+
+SequenceRenderer::~SequenceRenderer()
+{
+	Cancel();
+}
+
+bool SequenceRenderer::LoadFromFile(const char* filepath, const Scene& scene, std::vector<SequenceFrame>& frames)
+{
+	std::ifstream file(filepath);
+	if (!file.is_open())
+	{
+		std::cout << "could not open the sequence file " << filepath << std::endl;
+		return false;
+	}
+
+	// Model positions carry over from frame to frame, starting from the scene
+	std::vector<glm::vec3> modelPositions;
+	for (const Model* model : scene.Models)
+		modelPositions.push_back(model->Position);
+
+	frames.clear();
+
+	std::string line, prefix;
+	std::stringstream ss;
+	while (getline(file, line))
+	{
+		ss.clear();
+		ss.str(line);
+
+		prefix.clear();
+		ss >> prefix;
+
+		if (prefix == "camera")
+		{
+			SequenceFrame& frame = frames.emplace_back();
+			ss >> frame.CameraPosition.x >> frame.CameraPosition.y >> frame.CameraPosition.z;
+			ss >> frame.CameraDirection.x >> frame.CameraDirection.y >> frame.CameraDirection.z;
+
+			// A zero or vertical direction has no view basis, every ray of the frame would be NaN
+			if (ss.fail() || glm::cross(frame.CameraDirection, glm::vec3(0.0f, 1.0f, 0.0f)) == glm::vec3(0.0f))
+			{
+				std::cout << "invalid camera: " << line << std::endl;
+				return false;
+			}
+
+			frame.ModelPositions = modelPositions;
+		}
+		else if (prefix == "model")
+		{
+			size_t index;
+			glm::vec3 position;
+			ss >> index >> position.x >> position.y >> position.z;
+
+			if (ss.fail() || index >= modelPositions.size())
+			{
+				std::cout << "invalid model transform: " << line << std::endl;
+				return false;
+			}
+
+			modelPositions[index] = position;
+			if (!frames.empty())
+				frames.back().ModelPositions[index] = position;
+		}
+	}
+
+	return !frames.empty();
+}
+
+void SequenceRenderer::Start(Scene& scene, std::vector<SequenceFrame>&& frames, const SequenceSettings& settings)
+{
+	if (m_Running)
+		return;
+
+	if (m_Thread.joinable())
+		m_Thread.join();
+
+	m_Scene = &scene;
+	m_Frames = std::move(frames);
+	m_Settings = settings;
+
+	m_Cancel = false;
+	m_CompletedFrames = 0;
+	m_TraceTime = 0.0f;
+	m_TotalTime = 0.0f;
+
+	m_Running = true;
+	m_Thread = std::thread(&SequenceRenderer::Run, this);
+}
+
+void SequenceRenderer::Cancel()
+{
+	m_Cancel = true;
+
+	if (m_Thread.joinable())
+		m_Thread.join();
+}
+
+void SequenceRenderer::Run()
+{
+	Walnut::Timer totalTimer;
+
+	std::error_code error;
+	std::filesystem::create_directories(m_Settings.OutputDirectory, error);
+
+	m_Renderer.ConfigureThreads(m_Settings.ThreadCount, m_Settings.Cpus);
+	// The radiance cache carries over between frames, what it learned stays useful as the camera moves
+	m_Renderer.GetSettings().PathGuiding = m_Settings.PathGuiding;
+	m_Renderer.OnResize(m_Settings.Width, m_Settings.Height);
+	PrepareCamera(0);
+
+	// Frames move the models, they are put back afterwards so the next sequence starts from the same scene
+	std::vector<glm::vec3> initialPositions;
+	for (const Model* model : m_Scene->Models)
+		initialPositions.push_back(model->Position);
+
+	for (uint32_t i = 0; i < (uint32_t)m_Frames.size() && !m_Cancel; i++)
+	{
+		// Ray directions of the next frame are generated while this one is traced
+		std::future<void> nextCamera;
+		if (i + 1 < (uint32_t)m_Frames.size())
+			nextCamera = std::async(std::launch::async, &SequenceRenderer::PrepareCamera, this, i + 1);
+
+		const SequenceFrame& frame = m_Frames[i];
+		for (size_t m = 0; m < m_Scene->Models.size(); m++)
+			m_Scene->Models[m]->Position = frame.ModelPositions[m];
+
+		Walnut::Timer traceTimer;
+
+		m_Renderer.ResetFrameIndex();
+		for (uint32_t sample = 0; sample < m_Settings.SamplesPerPixel && !m_Cancel; sample++)
+			m_Renderer.Render(*m_Scene, m_Cameras[i % 2]);
+
+		m_TraceTime = m_TraceTime + traceTimer.Elapsed();
+
+		char filename[32];
+		snprintf(filename, sizeof(filename), "frame_%05u.ppm", i);
+
+		const uint32_t* imageData = m_Renderer.GetImageData();
+		std::vector<uint32_t> pixels(imageData, imageData + (size_t)m_Settings.Width * m_Settings.Height);
+		m_Writer.Submit((std::filesystem::path(m_Settings.OutputDirectory) / filename).string(),
+			m_Settings.Width, m_Settings.Height, std::move(pixels));
+
+		if (nextCamera.valid())
+			nextCamera.wait();
+
+		m_CompletedFrames++;
+	}
+
+	for (size_t m = 0; m < m_Scene->Models.size(); m++)
+		m_Scene->Models[m]->Position = initialPositions[m];
+
+	m_Writer.Flush();
+
+	m_TotalTime = totalTimer.Elapsed();
+	m_Running = false;
+}
+
+void SequenceRenderer::PrepareCamera(uint32_t frameIndex)
+{
+	const SequenceFrame& frame = m_Frames[frameIndex];
+
+	Camera& camera = m_Cameras[frameIndex % 2];
+	camera.OnResize(m_Settings.Width, m_Settings.Height);
+	camera.SetPose(frame.CameraPosition, frame.CameraDirection);
+}
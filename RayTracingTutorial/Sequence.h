@@ -0,0 +1,107 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Renderer.h"
+#include "Camera.h"
+#include "Scene.h"
+
+struct SequenceFrame
+{
+	glm::vec3 CameraPosition{ 0.0f, 0.0f, 6.0f };
+	glm::vec3 CameraDirection{ 0.0f, 0.0f, -1.0f };
+	// One position per scene model
+	std::vector<glm::vec3> ModelPositions;
+};
+
+struct SequenceSettings
+{
+	std::string OutputDirectory = "frames";
+	uint32_t Width = 1280, Height = 720;
+	uint32_t SamplesPerPixel = 64;
+
+	uint32_t ThreadCount = 0;
+	std::vector<uint32_t> Cpus;
+
+	bool PathGuiding = false;
+};
+
+// Encodes frames as binary PPM files and writes them on a background thread
+class FrameWriter
+{
+public:
+	FrameWriter();
+	~FrameWriter();
+
+	// Pixels are in the renderer's ABGR layout, bottom row first
+	void Submit(const std::string& filepath, uint32_t width, uint32_t height, std::vector<uint32_t>&& pixels);
+	// Blocks until every submitted frame is written
+	void Flush();
+private:
+	struct Job
+	{
+		std::string Filepath;
+		uint32_t Width, Height;
+		std::vector<uint32_t> Pixels;
+	};
+
+	void WorkerLoop();
+	static bool WritePPM(const Job& job);
+private:
+	std::deque<Job> m_Jobs;
+	std::mutex m_Mutex;
+	std::condition_variable m_JobAdded, m_JobDone;
+	bool m_Writing = false;
+	bool m_Stop = false;
+	std::thread m_Worker;
+};
+
+// Renders a list of frames in one go with the scene meshes kept resident.
+// Ray generation for frame N+1 runs while frame N is traced, and finished
+// images are encoded and written by a FrameWriter.
+class SequenceRenderer
+{
+public:
+	SequenceRenderer(float verticalFOV, float nearClip, float farClip);
+	~SequenceRenderer();
+
+	// Lines are "camera px py pz dx dy dz", starting a new frame, and "model index x y z",
+	// moving a model from the current frame on
+	static bool LoadFromFile(const char* filepath, const Scene& scene, std::vector<SequenceFrame>& frames);
+
+	// The scene is owned by the sequence until it finishes, its models are moved every frame
+	void Start(Scene& scene, std::vector<SequenceFrame>&& frames, const SequenceSettings& settings);
+	void Cancel();
+
+	bool IsRunning() const { return m_Running; }
+	uint32_t GetCompletedFrames() const { return m_CompletedFrames; }
+	uint32_t GetFrameCount() const { return (uint32_t)m_Frames.size(); }
+	float GetTraceTime() const { return m_TraceTime; }
+	float GetTotalTime() const { return m_TotalTime; }
+private:
+	void Run();
+	void PrepareCamera(uint32_t frameIndex);
+private:
+	Renderer m_Renderer{ true };
+	Camera m_Cameras[2];
+	FrameWriter m_Writer;
+
+	Scene* m_Scene = nullptr;
+	std::vector<SequenceFrame> m_Frames;
+	SequenceSettings m_Settings;
+
+	std::thread m_Thread;
+	std::atomic<bool> m_Running{ false };
+	std::atomic<bool> m_Cancel{ false };
+	std::atomic<uint32_t> m_CompletedFrames{ 0 };
+	// Seconds
+	std::atomic<float> m_TraceTime{ 0.0f };
+	std::atomic<float> m_TotalTime{ 0.0f };
+};
@@ -0,0 +1,409 @@
+#include "Texture.h"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace
+{
+	glm::vec3 UnpackColor(uint32_t texel)
+	{
+		return glm::vec3(
+			(float)(texel & 0xff),
+			(float)((texel >> 8) & 0xff),
+			(float)((texel >> 16) & 0xff)) / 255.0f;
+	}
+
+	// Box filters 2x2 blocks, the last row and column repeat for odd sizes
+	void Downsample(const std::vector<uint32_t>& source, uint32_t width, uint32_t height,
+		std::vector<uint32_t>& destination, uint32_t destinationWidth, uint32_t destinationHeight)
+	{
+		destination.resize((size_t)destinationWidth * destinationHeight);
+
+		for (uint32_t y = 0; y < destinationHeight; y++)
+		{
+			uint32_t y0 = std::min(y * 2, height - 1);
+			uint32_t y1 = std::min(y * 2 + 1, height - 1);
+
+			for (uint32_t x = 0; x < destinationWidth; x++)
+			{
+				uint32_t x0 = std::min(x * 2, width - 1);
+				uint32_t x1 = std::min(x * 2 + 1, width - 1);
+
+				uint32_t texels[4] =
+				{
+					source[x0 + y0 * width], source[x1 + y0 * width],
+					source[x0 + y1 * width], source[x1 + y1 * width],
+				};
+
+				uint32_t result = 0;
+				for (uint32_t shift = 0; shift < 32; shift += 8)
+				{
+					uint32_t sum = 2;
+					for (uint32_t texel : texels)
+						sum += (texel >> shift) & 0xff;
+					result |= (sum / 4) << shift;
+				}
+				destination[x + y * destinationWidth] = result;
+			}
+		}
+	}
+}
+
+bool Texture::LoadFromFile(const std::string& filepath)
+{
+	std::vector<uint32_t> image;
+	if (!Decode(filepath, image, m_Width, m_Height))
+		return false;
+
+	m_Filepath = filepath;
+
+	m_LevelCount = 1;
+	while ((std::max(m_Width, m_Height) >> m_LevelCount) > 0)
+		m_LevelCount++;
+
+	m_Levels = std::make_unique<Level[]>(m_LevelCount);
+
+	uint64_t tailMask = 0;
+	for (uint32_t i = 0; i < m_LevelCount; i++)
+	{
+		Level& level = m_Levels[i];
+		level.Width = std::max(m_Width >> i, 1u);
+		level.Height = std::max(m_Height >> i, 1u);
+		level.TilesX = (level.Width + TileSize - 1) / TileSize;
+		level.TilesY = (level.Height + TileSize - 1) / TileSize;
+
+		if (IsTailLevel(i))
+			tailMask |= 1ull << i;
+	}
+
+	// Finer levels are loaded once samples ask for them
+	std::vector<std::vector<uint32_t>> levels;
+	BuildLevels(std::move(image), tailMask, levels);
+	for (uint32_t i = 0; i < m_LevelCount; i++)
+		m_Levels[i].Texels = std::move(levels[i]);
+	return true;
+}
+
+glm::vec3 Texture::Sample(const glm::vec2& uv, float lod, uint32_t frame) const
+{
+	// Rounds to the nearest level, negative, infinite and NaN lods are clamped
+	uint32_t wanted = lod > 0.0f ? (uint32_t)std::min(lod + 0.5f, (float)(m_LevelCount - 1)) : 0;
+
+	// The tail is always resident, so this stops at the last level at the latest
+	uint32_t levelIndex = wanted;
+	while (m_Levels[levelIndex].Texels.empty())
+		levelIndex++;
+
+	// Loads and stores are kept apart so that hot levels are not written by every thread on every sample
+	if (levelIndex != wanted && !m_Levels[wanted].Requested.load(std::memory_order_relaxed))
+		m_Levels[wanted].Requested.store(true, std::memory_order_relaxed);
+
+	const Level& level = m_Levels[levelIndex];
+	if (level.LastUsedFrame.load(std::memory_order_relaxed) != frame)
+		level.LastUsedFrame.store(frame, std::memory_order_relaxed);
+
+	// Bilinear filtering with repeating texture coordinates
+	float x = (uv.x - std::floor(uv.x)) * level.Width - 0.5f;
+	float y = (uv.y - std::floor(uv.y)) * level.Height - 0.5f;
+	float floorX = std::floor(x);
+	float floorY = std::floor(y);
+	float fractionX = x - floorX;
+	float fractionY = y - floorY;
+
+	uint32_t x0 = floorX < 0.0f ? level.Width - 1 : std::min((uint32_t)floorX, level.Width - 1);
+	uint32_t y0 = floorY < 0.0f ? level.Height - 1 : std::min((uint32_t)floorY, level.Height - 1);
+	uint32_t x1 = x0 + 1 < level.Width ? x0 + 1 : 0;
+	uint32_t y1 = y0 + 1 < level.Height ? y0 + 1 : 0;
+
+	glm::vec3 top = UnpackColor(Fetch(level, x0, y0)) * (1.0f - fractionX) + UnpackColor(Fetch(level, x1, y0)) * fractionX;
+	glm::vec3 bottom = UnpackColor(Fetch(level, x0, y1)) * (1.0f - fractionX) + UnpackColor(Fetch(level, x1, y1)) * fractionX;
+	return top * (1.0f - fractionY) + bottom * fractionY;
+}
+
+bool Texture::IsTailLevel(uint32_t level) const
+{
+	return m_Levels[level].Width <= ResidentTailSize && m_Levels[level].Height <= ResidentTailSize;
+}
+
+bool Texture::Decode(const std::string& filepath, std::vector<uint32_t>& image, uint32_t& width, uint32_t& height)
+{
+	std::ifstream file(filepath, std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cout << "could not open the texture " << filepath << std::endl;
+		return false;
+	}
+
+	std::vector<stbi_uc> fileData((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	int imageWidth, imageHeight, channels;
+	stbi_uc* data = stbi_load_from_memory(fileData.data(), (int)fileData.size(), &imageWidth, &imageHeight, &channels, 4);
+	if (!data)
+	{
+		std::cout << "could not decode the texture " << filepath << ": " << stbi_failure_reason() << std::endl;
+		return false;
+	}
+
+	width = (uint32_t)imageWidth;
+	height = (uint32_t)imageHeight;
+	image.resize((size_t)width * height);
+	memcpy(image.data(), data, image.size() * sizeof(uint32_t));
+
+	stbi_image_free(data);
+	return true;
+}
+
+void Texture::BuildLevels(std::vector<uint32_t>&& image, uint64_t levelMask, std::vector<std::vector<uint32_t>>& levels) const
+{
+	std::vector<uint32_t> nextImage;
+	levels.resize(m_LevelCount);
+
+	for (uint32_t i = 0; i < m_LevelCount && (levelMask >> i) != 0; i++)
+	{
+		const Level& level = m_Levels[i];
+
+		if ((levelMask >> i) & 1)
+		{
+			// Texels past the image edge pad the last tiles and are never sampled
+			std::vector<uint32_t>& texels = levels[i];
+			texels.assign(level.GetSize() / sizeof(uint32_t), 0);
+
+			for (uint32_t y = 0; y < level.Height; y++)
+			{
+				for (uint32_t x = 0; x < level.Width; x++)
+				{
+					uint32_t tile = (x / TileSize) + (y / TileSize) * level.TilesX;
+					texels[tile * TileSize * TileSize + (x % TileSize) + (y % TileSize) * TileSize] = image[x + y * level.Width];
+				}
+			}
+		}
+
+		if (i + 1 < m_LevelCount)
+		{
+			const Level& next = m_Levels[i + 1];
+			Downsample(image, level.Width, level.Height, nextImage, next.Width, next.Height);
+			std::swap(image, nextImage);
+		}
+	}
+}
+
+uint32_t Texture::Fetch(const Level& level, uint32_t x, uint32_t y)
+{
+	uint32_t tile = (x / TileSize) + (y / TileSize) * level.TilesX;
+	return level.Texels[tile * TileSize * TileSize + (x % TileSize) + (y % TileSize) * TileSize];
+}
+
+TextureCache::TextureCache(size_t budget)
+	: m_Budget(budget)
+{
+}
+
+TextureCache::~TextureCache()
+{
+	// The decode reads its texture, it has to finish before the textures are destroyed
+	if (m_Loading.valid())
+		m_Loading.wait();
+}
+
+int TextureCache::Load(const std::string& filepath)
+{
+	// Materials sharing a file share the texture
+	for (size_t i = 0; i < m_Textures.size(); i++)
+	{
+		if (m_Textures[i]->GetFilepath() == filepath)
+			return (int)i;
+	}
+
+	std::unique_ptr<Texture> texture = std::make_unique<Texture>();
+	if (!texture->LoadFromFile(filepath))
+		return -1;
+
+	m_Textures.push_back(std::move(texture));
+	return (int)m_Textures.size() - 1;
+}
+
+void TextureCache::Update()
+{
+	m_Frame++;
+	m_PendingRequests = 0;
+
+	bool loading = m_Loading.valid();
+	if (loading && m_Loading.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+	{
+		Publish();
+		loading = false;
+	}
+
+	if (loading)
+		m_PendingRequests += (uint32_t)std::bitset<64>(m_LoadingMask).count();
+
+	// Only one texture is decoded at a time, so a burst of requests does not keep the loader
+	// busy with textures nobody looks at anymore. The others ask again in the next frame.
+	uint32_t textureCount = (uint32_t)m_Textures.size();
+	Texture* selected = nullptr;
+	uint64_t levelMask = 0;
+
+	for (uint32_t i = 0; i < textureCount; i++)
+	{
+		uint32_t textureIndex = (m_NextTexture + i) % textureCount;
+		Texture& texture = *m_Textures[textureIndex];
+
+		for (uint32_t level = 0; level < texture.m_LevelCount; level++)
+		{
+			// Requests raised before a decode was published can ask for levels that are resident by now
+			if (!texture.m_Levels[level].Requested.exchange(false) || !texture.m_Levels[level].Texels.empty() || texture.m_LoadFailed)
+				continue;
+
+			if (!selected && !loading)
+			{
+				selected = &texture;
+				m_NextTexture = textureIndex + 1;
+			}
+
+			if (selected == &texture)
+				levelMask |= 1ull << level;
+			else
+				m_PendingRequests++;
+		}
+	}
+
+	if (!selected)
+		return;
+
+	// Coarse levels are cheaper and serve as the fallback of the finer ones, so they get the room first
+	size_t reserved = 0;
+	for (uint32_t level = selected->m_LevelCount; level-- > 0;)
+	{
+		if (!((levelMask >> level) & 1))
+			continue;
+
+		size_t size = selected->m_Levels[level].GetSize();
+		if (MakeRoom(reserved + size))
+		{
+			reserved += size;
+		}
+		else
+		{
+			levelMask &= ~(1ull << level);
+			m_PendingRequests++;
+		}
+	}
+
+	if (levelMask == 0)
+		return;
+
+	// The loader only reads the file and the level sizes, the texture keeps being sampled meanwhile
+	const Texture* texture = selected;
+	m_LoadingTexture = selected;
+	m_LoadingMask = levelMask;
+	m_PendingRequests += (uint32_t)std::bitset<64>(levelMask).count();
+
+	m_Loading = std::async(std::launch::async, [texture, levelMask]()
+		{
+			std::vector<std::vector<uint32_t>> levels;
+			std::vector<uint32_t> image;
+			uint32_t width, height;
+			if (!Texture::Decode(texture->m_Filepath, image, width, height))
+				return levels;
+
+			if (width != texture->m_Width || height != texture->m_Height)
+			{
+				std::cout << "the texture " << texture->m_Filepath << " changed size on disk" << std::endl;
+				return levels;
+			}
+
+			texture->BuildLevels(std::move(image), levelMask, levels);
+			return levels;
+		});
+}
+
+void TextureCache::Publish()
+{
+	std::vector<std::vector<uint32_t>> levels = m_Loading.get();
+	Texture& texture = *m_LoadingTexture;
+	m_LoadingTexture = nullptr;
+	m_LoadingMask = 0;
+
+	if (levels.empty())
+	{
+		texture.m_LoadFailed = true;
+		return;
+	}
+
+	for (uint32_t level = texture.m_LevelCount; level-- > 0;)
+	{
+		Texture::Level& target = texture.m_Levels[level];
+		if (levels[level].empty() || !target.Texels.empty())
+			continue;
+
+		if (!MakeRoom(target.GetSize()))
+		{
+			m_PendingRequests++;
+			continue;
+		}
+
+		// Counts as used, so making room for the next level does not evict it again
+		target.Texels = std::move(levels[level]);
+		target.LastUsedFrame.store(m_Frame, std::memory_order_relaxed);
+	}
+}
+
+void TextureCache::SetBudget(size_t budget)
+{
+	m_Budget = budget;
+	MakeRoom(0, false);
+}
+
+size_t TextureCache::GetResidentSize() const
+{
+	size_t size = 0;
+	for (const std::unique_ptr<Texture>& texture : m_Textures)
+	{
+		for (uint32_t level = 0; level < texture->m_LevelCount; level++)
+		{
+			if (!texture->m_Levels[level].Texels.empty())
+				size += texture->m_Levels[level].GetSize();
+		}
+	}
+	return size;
+}
+
+bool TextureCache::MakeRoom(size_t size, bool keepRecent)
+{
+	size_t residentSize = GetResidentSize();
+
+	while (residentSize + size > m_Budget)
+	{
+		Texture::Level* oldest = nullptr;
+
+		for (const std::unique_ptr<Texture>& texture : m_Textures)
+		{
+			for (uint32_t level = 0; level < texture->m_LevelCount; level++)
+			{
+				Texture::Level& candidate = texture->m_Levels[level];
+				if (candidate.Texels.empty() || texture->IsTailLevel(level) || (keepRecent && candidate.LastUsedFrame + 1 >= m_Frame))
+					continue;
+
+				if (!oldest || candidate.LastUsedFrame < oldest->LastUsedFrame)
+					oldest = &candidate;
+			}
+		}
+
+		if (!oldest)
+			return false;
+
+		residentSize -= oldest->GetSize();
+		oldest->Texels.clear();
+		oldest->Texels.shrink_to_fit();
+	}
+
+	return true;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+// RGBA8 texture with a full mip chain. Every level is stored in 8x8 texel tiles, so the
+// texels around a sample point share a few cache lines no matter which way the ray moves
+// across the texture. Levels finer than the resident tail can be evicted and are read and
+// decoded again from the file when they are needed.
+class Texture
+{
+public:
+	static constexpr uint32_t TileSize = 8;
+	// Levels this size and smaller are never evicted, they are the fallback of every sample
+	static constexpr uint32_t ResidentTailSize = 64;
+
+	Texture() = default;
+	Texture(const Texture&) = delete;
+	Texture& operator=(const Texture&) = delete;
+
+	bool LoadFromFile(const std::string& filepath);
+
+	const std::string& GetFilepath() const { return m_Filepath; }
+	uint32_t GetWidth() const { return m_Width; }
+	uint32_t GetHeight() const { return m_Height; }
+	uint32_t GetLevelCount() const { return m_LevelCount; }
+
+	// Level 0 is sampled at one texel per unit of lod, every further unit halves the resolution.
+	// Falls back to the closest coarser resident level and requests the wanted one.
+	glm::vec3 Sample(const glm::vec2& uv, float lod, uint32_t frame) const;
+private:
+	friend class TextureCache;
+
+	struct Level
+	{
+		uint32_t Width = 0, Height = 0;
+		uint32_t TilesX = 0, TilesY = 0;
+		// Empty while the level is not resident
+		std::vector<uint32_t> Texels;
+
+		// Written by the sampling threads
+		mutable std::atomic<uint32_t> LastUsedFrame{ 0 };
+		mutable std::atomic<bool> Requested{ false };
+
+		size_t GetSize() const { return (size_t)TilesX * TilesY * TileSize * TileSize * sizeof(uint32_t); }
+	};
+
+	bool IsTailLevel(uint32_t level) const;
+	// Reads and decodes the file into row major RGBA8 texels
+	static bool Decode(const std::string& filepath, std::vector<uint32_t>& image, uint32_t& width, uint32_t& height);
+	// Downsamples the image through the chain and tiles the levels of the mask into levels, bit i selects level i.
+	// Only the level sizes are read, so this runs on a loader thread while the texture is sampled.
+	void BuildLevels(std::vector<uint32_t>&& image, uint64_t levelMask, std::vector<std::vector<uint32_t>>& levels) const;
+	static uint32_t Fetch(const Level& level, uint32_t x, uint32_t y);
+private:
+	std::string m_Filepath;
+
+	uint32_t m_Width = 0, m_Height = 0;
+	uint32_t m_LevelCount = 0;
+	std::unique_ptr<Level[]> m_Levels;
+	// Set when the file could not be loaded again, finer levels are no longer requested
+	bool m_LoadFailed = false;
+};
+
+// Owns the textures of a scene and keeps their resident levels within a memory budget.
+// Samples record which levels they wanted, and Update has them decoded on a background thread
+// and publishes them at a later update, evicting the least recently used levels. Rays after a
+// diffuse bounce ask for coarse levels, so they do not push the detailed levels of the primary
+// hits out of the cache.
+class TextureCache
+{
+public:
+	explicit TextureCache(size_t budget = 256ull * 1024 * 1024);
+	~TextureCache();
+
+	// Returns the index for Material::TextureIndex, -1 if the file could not be loaded
+	int Load(const std::string& filepath);
+
+	uint32_t GetTextureCount() const { return (uint32_t)m_Textures.size(); }
+	const Texture& GetTexture(int index) const { return *m_Textures[index]; }
+
+	glm::vec3 Sample(int index, const glm::vec2& uv, float lod) const { return m_Textures[index]->Sample(uv, lod, m_Frame); }
+
+	// Publishes the levels of a finished decode and starts decoding newly requested ones.
+	// Must not run while textures are sampled, the renderer calls it before every frame.
+	void Update();
+
+	// Evicts down to the new budget right away, only the resident tail is kept regardless
+	void SetBudget(size_t budget);
+	size_t GetBudget() const { return m_Budget; }
+	size_t GetResidentSize() const;
+	// Requests of the last update that are still decoding, did not fit into the budget or were deferred
+	uint32_t GetPendingRequests() const { return m_PendingRequests; }
+private:
+	// Evicts least recently used levels until the size fits, levels used in the last frame are kept unless keepRecent is false
+	bool MakeRoom(size_t size, bool keepRecent = true);
+	// Moves the decoded levels into their texture, the budget may have shrunk since the decode started
+	void Publish();
+private:
+	std::vector<std::unique_ptr<Texture>> m_Textures;
+	size_t m_Budget;
+	uint32_t m_Frame = 1;
+	uint32_t m_PendingRequests = 0;
+	// Textures take turns in being loaded, so one that never fits does not block the others
+	uint32_t m_NextTexture = 0;
+
+	// At most one decode runs at a time, its result holds one texel vector per level, empty on failure
+	Texture* m_LoadingTexture = nullptr;
+	uint64_t m_LoadingMask = 0;
+	std::future<std::vector<std::vector<uint32_t>>> m_Loading;
+};
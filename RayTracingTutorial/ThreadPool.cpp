@@ -0,0 +1,226 @@
+#include "ThreadPool.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#if defined(WL_PLATFORM_WINDOWS)
+	#define NOMINMAX
+	#include <Windows.h>
+#elif defined(__linux__)
+	#include <pthread.h>
+	#include <sched.h>
+#endif
+
+namespace
+{
+	bool PinCurrentThread(uint32_t cpu)
+	{
+#if defined(WL_PLATFORM_WINDOWS)
+		// Only the first processor group is addressed, which covers up to 64 logical CPUs
+		if (cpu >= 64)
+			return false;
+		return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#elif defined(__linux__)
+		if (cpu >= CPU_SETSIZE)
+			return false;
+
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+		(void)cpu;
+		return false;
+#endif
+	}
+
+	// Parses a plain decimal CPU index, signs, blanks and values past the limit are rejected
+	bool ParseCpu(const char* text, const char*& end, uint32_t& cpu)
+	{
+		if (!std::isdigit((unsigned char)*text))
+			return false;
+
+		errno = 0;
+		char* parsedEnd = nullptr;
+		unsigned long value = std::strtoul(text, &parsedEnd, 10);
+		end = parsedEnd;
+
+		if (errno == ERANGE || value >= ThreadPool::MaxCpus)
+			return false;
+
+		cpu = (uint32_t)value;
+		return true;
+	}
+}
+
+ThreadPool::ThreadPool(uint32_t workerCount)
+{
+	Start(workerCount);
+}
+
+ThreadPool::~ThreadPool()
+{
+	Stop();
+}
+
+void ThreadPool::Configure(uint32_t workerCount, const std::vector<uint32_t>& cpus)
+{
+	Stop();
+	m_Cpus = cpus;
+	Start(workerCount);
+}
+
+void ThreadPool::ParallelFor(uint32_t begin, uint32_t end, const std::function<void(uint32_t)>& function)
+{
+	if (begin >= end)
+		return;
+
+	uint32_t workerCount = GetWorkerCount();
+	uint32_t count = end - begin;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		for (uint32_t i = 0; i < workerCount; i++)
+		{
+			m_Shares[i].Next = begin + (uint32_t)((uint64_t)count * i / workerCount);
+			m_Shares[i].End = begin + (uint32_t)((uint64_t)count * (i + 1) / workerCount);
+		}
+
+		m_Function = &function;
+		m_BusyWorkers = workerCount;
+		m_Generation++;
+	}
+	m_WorkAvailable.notify_all();
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_WorkDone.wait(lock, [this]() { return m_BusyWorkers == 0; });
+	m_Function = nullptr;
+}
+
+uint32_t ThreadPool::GetHardwareThreadCount()
+{
+	uint32_t count = std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+bool ThreadPool::ParseThreadCount(const std::string& text, uint32_t& threadCount)
+{
+	uint32_t maxThreadCount = GetHardwareThreadCount() * MaxOversubscription;
+
+	errno = 0;
+	char* end = nullptr;
+	unsigned long value = std::isdigit((unsigned char)text.c_str()[0]) ? std::strtoul(text.c_str(), &end, 10) : 0;
+
+	if (value == 0 || *end != '\0' || errno == ERANGE || value > maxThreadCount)
+	{
+		std::cout << "invalid thread count " << text << ", expected 1 to " << maxThreadCount << std::endl;
+		return false;
+	}
+
+	threadCount = (uint32_t)value;
+	return true;
+}
+
+bool ThreadPool::ParseCpuList(const std::string& list, std::vector<uint32_t>& cpus)
+{
+	cpus.clear();
+
+	std::stringstream ss(list);
+	std::string item;
+	while (getline(ss, item, ','))
+	{
+		const char* end = nullptr;
+		uint32_t first, last;
+		bool valid = ParseCpu(item.c_str(), end, first);
+		last = first;
+
+		if (valid && *end == '-')
+			valid = ParseCpu(end + 1, end, last) && last >= first;
+
+		if (!valid || *end != '\0')
+		{
+			std::cout << "invalid CPU list entry \"" << item << "\" in " << list << std::endl;
+			cpus.clear();
+			return false;
+		}
+
+		for (uint32_t cpu = first; cpu <= last; cpu++)
+			cpus.push_back(cpu);
+	}
+
+	if (cpus.empty())
+		std::cout << "empty CPU list" << std::endl;
+	return !cpus.empty();
+}
+
+void ThreadPool::Start(uint32_t workerCount)
+{
+	if (workerCount == 0)
+		workerCount = m_Cpus.empty() ? GetHardwareThreadCount() : (uint32_t)m_Cpus.size();
+
+	m_Stop = false;
+	m_Generation = 0;
+	m_Shares = std::make_unique<Share[]>(workerCount);
+
+	for (uint32_t i = 0; i < workerCount; i++)
+		m_Workers.emplace_back(&ThreadPool::WorkerLoop, this, i, workerCount);
+}
+
+void ThreadPool::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stop = true;
+	}
+	m_WorkAvailable.notify_all();
+
+	for (std::thread& worker : m_Workers)
+		worker.join();
+
+	m_Workers.clear();
+}
+
+void ThreadPool::WorkerLoop(uint32_t workerIndex, uint32_t workerCount)
+{
+	if (!m_Cpus.empty())
+	{
+		uint32_t cpu = m_Cpus[workerIndex % m_Cpus.size()];
+		if (!PinCurrentThread(cpu))
+			std::cout << "could not pin worker " << workerIndex << " to CPU " << cpu << std::endl;
+	}
+
+	uint64_t generation = 0;
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (true)
+	{
+		m_WorkAvailable.wait(lock, [this, generation]() { return m_Stop || m_Generation != generation; });
+		if (m_Stop)
+			return;
+
+		generation = m_Generation;
+		lock.unlock();
+
+		// Own share first, then help with the others
+		for (uint32_t i = 0; i < workerCount; i++)
+			RunShare((workerIndex + i) % workerCount);
+
+		lock.lock();
+		if (--m_BusyWorkers == 0)
+			m_WorkDone.notify_one();
+	}
+}
+
+void ThreadPool::RunShare(uint32_t shareIndex)
+{
+	Share& share = m_Shares[shareIndex];
+
+	uint32_t index;
+	while ((index = share.Next.fetch_add(1)) < share.End)
+		(*m_Function)(index);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running parallel loops, optionally pinned to a set of CPUs.
+// Every worker owns a contiguous share of a loop and only helps with the other shares once
+// its own is done, so with pinned workers the same indices keep running on the same CPU.
+class ThreadPool
+{
+public:
+	// A worker count of 0 uses every hardware thread
+	explicit ThreadPool(uint32_t workerCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Worker i is pinned to cpus[i % cpus.size()], an empty set leaves the workers unpinned
+	void Configure(uint32_t workerCount, const std::vector<uint32_t>& cpus = {});
+
+	uint32_t GetWorkerCount() const { return (uint32_t)m_Workers.size(); }
+	const std::vector<uint32_t>& GetCpus() const { return m_Cpus; }
+
+	// Calls function for every index in [begin, end) and blocks until all calls returned.
+	// Must not be called from several threads at once.
+	void ParallelFor(uint32_t begin, uint32_t end, const std::function<void(uint32_t)>& function);
+
+	// CPU indices at and above this are rejected
+	static constexpr uint32_t MaxCpus = 1024;
+	// Worker counts above this many per hardware thread are rejected
+	static constexpr uint32_t MaxOversubscription = 4;
+
+	static uint32_t GetHardwareThreadCount();
+	// Accepts a plain decimal count from 1 to MaxOversubscription workers per hardware thread
+	static bool ParseThreadCount(const std::string& text, uint32_t& threadCount);
+	// Accepts lists like "0,2,4-7", a malformed entry rejects the whole list
+	static bool ParseCpuList(const std::string& list, std::vector<uint32_t>& cpus);
+private:
+	struct Share
+	{
+		std::atomic<uint32_t> Next{ 0 };
+		uint32_t End = 0;
+	};
+
+	void Start(uint32_t workerCount);
+	void Stop();
+	void WorkerLoop(uint32_t workerIndex, uint32_t workerCount);
+	void RunShare(uint32_t shareIndex);
+private:
+	std::vector<std::thread> m_Workers;
+	std::vector<uint32_t> m_Cpus;
+	std::unique_ptr<Share[]> m_Shares;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_WorkAvailable, m_WorkDone;
+	const std::function<void(uint32_t)>* m_Function = nullptr;
+	uint64_t m_Generation = 0;
+	uint32_t m_BusyWorkers = 0;
+	bool m_Stop = false;
+};
@@ -10,4 +10,11 @@ struct Triangle {
 	glm::vec3 B;
 	glm::vec3 C;
 	glm::vec3 Normal;
+
+	// Texture coordinates of A, B and C
+	glm::vec2 UVA{ 0.0f };
+	glm::vec2 UVB{ 0.0f };
+	glm::vec2 UVC{ 0.0f };
+	// Half the log2 of texture space area over world space area, the distance independent part of the mip level
+	float TextureLod = 0.0f;
 };
\ No newline at end of file
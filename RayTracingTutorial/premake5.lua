@@ -12,6 +12,7 @@ project "RayTracingTutorial"
       "../Walnut/vendor/imgui",
       "../Walnut/vendor/glfw/include",
       "../Walnut/vendor/glm",
+      "../Walnut/vendor/stb_image",
 
       "../Walnut/Walnut/src",
 
@@ -7,49 +7,210 @@
 #include "../Renderer.h"
 #include "../Camera.h"
 #include "../Benchmark.h"
+#include "../Checkpoint.h"
+#include "../Sequence.h"
 
 #include <glm/gtc/type_ptr.hpp>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
 
 using namespace Walnut;
 
+struct AppOptions
+{
+	std::string CheckpointPath = "render.ckpt";
+	// Seconds between automatic checkpoints, 0 disables them
+	float CheckpointInterval = 0.0f;
+	bool Resume = false;
+
+	// Renders the sequence at startup and exits once it is written
+	std::string SequencePath;
+	SequenceSettings Sequence;
+
+	// 0 uses every hardware thread, or every listed CPU
+	uint32_t ThreadCount = 0;
+	std::vector<uint32_t> Cpus;
+	// Sweeps 1..N render threads at startup, prints the results and exits
+	bool ScalingBenchmark = false;
+
+	// Material index and texture file pairs
+	std::vector<std::pair<int, std::string>> Textures;
+	// Megabytes, 0 keeps the default
+	uint32_t TextureBudget = 0;
+
+	bool PathGuiding = false;
+	// 0 keeps the default radiance cache size
+	uint32_t RadianceCacheCells = 0;
+};
+
+constexpr uint32_t MaxSequenceSamples = 1 << 20;
+constexpr uint32_t MaxSequenceResolution = 16384;
+
+// Accepts a plain decimal value from 1 to maxValue, anything else keeps the default
+static void ParseCount(const std::string& option, const char* text, uint32_t maxValue, uint32_t& value)
+{
+	char* end = nullptr;
+	unsigned long parsed = std::isdigit((unsigned char)text[0]) ? std::strtoul(text, &end, 10) : 0;
+
+	if (parsed == 0 || *end != '\0' || parsed > maxValue)
+	{
+		std::cout << "invalid value " << text << " for " << option << ", expected 1 to " << maxValue << std::endl;
+		return;
+	}
+
+	value = (uint32_t)parsed;
+}
+
+static AppOptions ParseCommandLine(int argc, char** argv)
+{
+	AppOptions options;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "--checkpoint" && i + 1 < argc)
+			options.CheckpointPath = argv[++i];
+		else if (arg == "--checkpoint-interval" && i + 1 < argc)
+			options.CheckpointInterval = (float)std::atof(argv[++i]);
+		else if (arg == "--resume")
+			options.Resume = true;
+		else if (arg == "--sequence" && i + 1 < argc)
+			options.SequencePath = argv[++i];
+		else if (arg == "--output" && i + 1 < argc)
+			options.Sequence.OutputDirectory = argv[++i];
+		else if (arg == "--spp" && i + 1 < argc)
+			ParseCount(arg, argv[++i], MaxSequenceSamples, options.Sequence.SamplesPerPixel);
+		else if (arg == "--width" && i + 1 < argc)
+			ParseCount(arg, argv[++i], MaxSequenceResolution, options.Sequence.Width);
+		else if (arg == "--height" && i + 1 < argc)
+			ParseCount(arg, argv[++i], MaxSequenceResolution, options.Sequence.Height);
+		else if (arg == "--threads" && i + 1 < argc)
+		{
+			// Every hardware thread is used when the count is invalid
+			ThreadPool::ParseThreadCount(argv[++i], options.ThreadCount);
+		}
+		else if (arg == "--cpus" && i + 1 < argc)
+		{
+			// Workers stay unpinned when the list is invalid
+			ThreadPool::ParseCpuList(argv[++i], options.Cpus);
+		}
+		else if (arg == "--scaling-benchmark")
+			options.ScalingBenchmark = true;
+		else if (arg == "--texture" && i + 2 < argc)
+		{
+			int materialIndex = std::atoi(argv[++i]);
+			options.Textures.emplace_back(materialIndex, argv[++i]);
+		}
+		else if (arg == "--texture-budget" && i + 1 < argc)
+			options.TextureBudget = (uint32_t)std::atoi(argv[++i]);
+		else if (arg == "--guiding")
+			options.PathGuiding = true;
+		else if (arg == "--radiance-cache-cells" && i + 1 < argc)
+			options.RadianceCacheCells = (uint32_t)std::atoi(argv[++i]);
+		else
+			std::cout << "unknown argument " << arg << std::endl;
+	}
+
+	options.Sequence.ThreadCount = options.ThreadCount;
+	options.Sequence.Cpus = options.Cpus;
+	options.Sequence.PathGuiding = options.PathGuiding;
+
+	return options;
+}
+
+static void CreateScene(Scene& scene)
+{
+	scene.BackgroundColor = glm::vec3(0.6f, 0.7f, 0.9f);
+
+	Material& pinkMaterial = scene.Materials.emplace_back();
+	pinkMaterial.Albedo = { 1.0f, 0.0f, 1.0f };
+	pinkMaterial.Roughness = 0.3f;
+
+	Material& blueMaterial = scene.Materials.emplace_back();
+	blueMaterial.Albedo = { 0.2f, 0.3f, 1.0f };
+	blueMaterial.Roughness = 0.9f;
+
+	Material& orangeMaterial = scene.Materials.emplace_back();
+	orangeMaterial.Albedo = { 0.8f, 0.5f, 0.2f };
+	orangeMaterial.Roughness = 0.1f;
+	orangeMaterial.EmissionColor = orangeMaterial.Albedo;
+	orangeMaterial.EmissionPower = 2.0f;
+
+	{
+		Model* model = new Model();
+		model->LoadFromOBJ("models/cube.obj");
+		model->Position = glm::vec3{ 2.0f, 0.0f, 0.0f };
+		model->m_materialIndex = 2;
+		scene.Models.push_back(model);
+	}
+}
+
 class ExampleLayer : public Walnut::Layer
 {
 public:
-	ExampleLayer()
-		: m_Camera(45.0f, 0.1f, 100.f)
+	ExampleLayer(const AppOptions& options)
+		: m_Camera(45.0f, 0.1f, 100.f), m_Sequence(45.0f, 0.1f, 100.f)
 	{
-		m_Scene.BackgroundColor = glm::vec3(0.6f, 0.7f, 0.9f);
+		strncpy(m_CheckpointPath, options.CheckpointPath.c_str(), sizeof(m_CheckpointPath) - 1);
+		m_AutoCheckpoint = options.CheckpointInterval > 0.0f;
+		if (m_AutoCheckpoint)
+			m_CheckpointInterval = options.CheckpointInterval;
+
+		CreateScene(m_Scene);
 
-		Material& pinkMaterial = m_Scene.Materials.emplace_back();
-		pinkMaterial.Albedo = { 1.0f, 0.0f, 1.0f };
-		pinkMaterial.Roughness = 0.3f;
+		m_Renderer.GetSettings().PathGuiding = options.PathGuiding;
+		if (options.RadianceCacheCells > 0)
+			m_Renderer.GetRadianceCache().Configure(options.RadianceCacheCells, m_Renderer.GetRadianceCache().GetCellSize());
 
-		Material& blueMaterial = m_Scene.Materials.emplace_back();
-		blueMaterial.Albedo = { 0.2f, 0.3f, 1.0f };
-		blueMaterial.Roughness = 0.9f;
+		if (options.TextureBudget > 0)
+			m_Scene.Textures->SetBudget((size_t)options.TextureBudget * 1024 * 1024);
+		for (const auto& [materialIndex, filepath] : options.Textures)
+		{
+			if (materialIndex >= 0 && materialIndex < (int)m_Scene.Materials.size())
+				m_Scene.Materials[materialIndex].TextureIndex = m_Scene.Textures->Load(filepath);
+			else
+				std::cout << "invalid material index " << materialIndex << " for texture " << filepath << std::endl;
+		}
 
-		Material& orangeMaterial = m_Scene.Materials.emplace_back();
-		orangeMaterial.Albedo = { 0.8f, 0.5f, 0.2f };
-		orangeMaterial.Roughness = 0.1f;
-		orangeMaterial.EmissionColor = orangeMaterial.Albedo;
-		orangeMaterial.EmissionPower = 2.0f;
+		if (options.Resume)
+			LoadCheckpoint();
 
+		strncpy(m_SequencePath, options.SequencePath.c_str(), sizeof(m_SequencePath) - 1);
+		m_SequenceSettings = options.Sequence;
+		// Batch mode exits once the sequence is written, or right away when it cannot be started
+		if (!options.SequencePath.empty())
 		{
-			Model* model = new Model();
-			model->LoadFromOBJ("models/cube.obj");
-			model->Position = glm::vec3{ 2.0f, 0.0f, 0.0f };
-			model->m_materialIndex = 2;
-			m_Scene.Models.push_back(model);
+			m_ExitAfterSequence = true;
+			if (!StartSequence())
+				std::cout << "could not start the sequence " << options.SequencePath << std::endl;
 		}
 
+		if (options.ThreadCount > 0 || !options.Cpus.empty())
+			m_Renderer.ConfigureThreads(options.ThreadCount, options.Cpus);
+		m_ThreadCount = (int)m_Renderer.GetThreadPool().GetWorkerCount();
+
+		if (options.ScalingBenchmark)
+		{
+			StartScalingBenchmark();
+			m_ExitAfterScalingBenchmark = true;
+		}
 	}
 	virtual void OnUpdate(float ts) override
 	{
+		if (m_ExitAfterSequence && !m_Sequence.IsRunning())
+			Walnut::Application::Get().Close();
+
+		if (m_ExitAfterScalingBenchmark && m_ScalingThreadCount == 0)
+			Walnut::Application::Get().Close();
+
 		if (m_Camera.OnUpdate(ts))
-		{
-			m_Renderer.ResetFrameIndex();
-			m_benchmark.ResetAverage();
-		}
+			ResetAccumulation();
 	}
 
 	virtual void OnUIRender() override
@@ -57,6 +218,8 @@ public:
 		ImGui::Begin("Settings");
 		ImGui::Text("Last render: %.3fms", m_LastRenderTime);
 		ImGui::Text("Average render: %.3fms", m_benchmark.GetAverageRenderTime());
+		ImGui::Text("Samples/sec: %.2fM", m_Renderer.GetScheduler().GetSamplesPerSecond() / 1000000.0f);
+		ImGui::Text("Passes: %u", m_Renderer.GetFrameIndex() - 1);
 		if (ImGui::Button("Render"))
 		{
 			Render();
@@ -64,20 +227,157 @@ public:
 
 		ImGui::Checkbox("Accumulate", &m_Renderer.GetSettings().Accumulate);
 
+		// Switching kernels keeps the previous throughput to show the difference between both paths
+		if (ImGui::Checkbox("Specialized kernels", &m_Renderer.GetSettings().SpecializedKernels))
+			m_benchmark.StoreBaseline(m_Renderer.GetScheduler().GetSamplesPerSecond());
+
+		if (m_benchmark.GetBaselineSamplesPerSecond() > 0.0f)
+		{
+			float samplesPerSecond = m_Renderer.GetScheduler().GetSamplesPerSecond();
+			ImGui::Text("Baseline: %.2fM samples/sec (%.2fx)", m_benchmark.GetBaselineSamplesPerSecond() / 1000000.0f,
+				samplesPerSecond / m_benchmark.GetBaselineSamplesPerSecond());
+		}
+
+		if (ImGui::Checkbox("Packet tracing", &m_Renderer.GetSettings().PacketTracing))
+			m_benchmark.StoreBaseline(m_Renderer.GetScheduler().GetSamplesPerSecond());
+
 		if (ImGui::Button("Reset"))
+			ResetAccumulation();
+
+		if (ImGui::Button("Benchmark primary rays"))
+		{
+			m_SingleRayThroughput = m_Renderer.BenchmarkPrimaryRays(m_Scene, m_Camera, false);
+			m_PacketRayThroughput = m_Renderer.BenchmarkPrimaryRays(m_Scene, m_Camera, true);
+		}
+
+		if (m_SingleRayThroughput > 0.0f)
+		{
+			ImGui::Text("Primary rays: %.2fM/s single, %.2fM/s packets (%.2fx)", m_SingleRayThroughput / 1000000.0f,
+				m_PacketRayThroughput / 1000000.0f, m_PacketRayThroughput / m_SingleRayThroughput);
+		}
+
+		ImGui::Separator();
+
+		ImGui::InputText("Checkpoint", m_CheckpointPath, sizeof(m_CheckpointPath));
+		ImGui::Checkbox("Auto checkpoint", &m_AutoCheckpoint);
+		ImGui::DragFloat("Checkpoint interval (s)", &m_CheckpointInterval, 1.0f, 1.0f, 3600.0f);
+
+		if (ImGui::Button("Save checkpoint"))
+			SaveCheckpoint();
+		ImGui::SameLine();
+		if (ImGui::Button("Resume"))
+			LoadCheckpoint();
+
+		if (m_CheckpointWriter.IsBusy())
+			ImGui::Text("Writing checkpoint...");
+		else if (!m_CheckpointWriter.GetLastResult())
+			ImGui::Text("Last checkpoint failed");
+
+		ImGui::Separator();
+
+		Renderer::Settings& settings = m_Renderer.GetSettings();
+		ImGui::Checkbox("Frame budget", &settings.FrameBudget);
+		ImGui::DragFloat("Target frame time (ms)", &settings.TargetFrameTime, 0.5f, 1.0f, 1000.0f);
+
+		ImGui::Separator();
+
+		// Guided and unguided samples have the same expected value, the accumulation is still restarted
+		// so the image shows each estimator on its own
+		if (ImGui::Checkbox("Path guiding", &settings.PathGuiding))
 		{
-			m_Renderer.ResetFrameIndex();
-			m_benchmark.ResetAverage();
+			m_benchmark.StoreBaseline(m_Renderer.GetScheduler().GetSamplesPerSecond());
+			ResetAccumulation();
+		}
+		ImGui::DragFloat("Guide fraction", &settings.GuideFraction, 0.05f, 0.0f, 0.95f);
+		if (ImGui::Checkbox("Cache termination", &settings.CacheTermination))
+			ResetAccumulation();
+
+		RadianceCache& radianceCache = m_Renderer.GetRadianceCache();
+		float cellSize = radianceCache.GetCellSize();
+		if (ImGui::DragFloat("Cache cell size", &cellSize, 0.01f, 0.01f, 10.0f))
+			radianceCache.Configure(radianceCache.GetCapacity(), cellSize);
+		ImGui::Text("Radiance cache: %u/%u cells, %.1fMB", radianceCache.GetCellCount(), radianceCache.GetCapacity(),
+			radianceCache.GetMemoryUsage() / (1024.0f * 1024.0f));
+		if (ImGui::Button("Clear radiance cache"))
+			radianceCache.Clear();
+
+		ImGui::Separator();
+
+		TextureCache& textures = *m_Scene.Textures;
+		int textureBudget = (int)(textures.GetBudget() / (1024 * 1024));
+		if (ImGui::DragInt("Texture budget (MB)", &textureBudget, 1.0f, 1, 16384))
+			textures.SetBudget((size_t)textureBudget * 1024 * 1024);
+		ImGui::Text("Textures: %u, %.1fMB resident, %u requests pending", textures.GetTextureCount(),
+			textures.GetResidentSize() / (1024.0f * 1024.0f), textures.GetPendingRequests());
+
+		ImGui::Separator();
+
+		const ThreadPool& threadPool = m_Renderer.GetThreadPool();
+		// Reconfiguring places the buffers again, which drops the accumulation
+		if (ImGui::SliderInt("Threads", &m_ThreadCount, 1, (int)GetMaxThreadCount()))
+		{
+			m_Renderer.ConfigureThreads((uint32_t)m_ThreadCount, threadPool.GetCpus());
+			ResetAccumulation();
+		}
+		if (!threadPool.GetCpus().empty())
+			ImGui::Text("Pinned to %u CPUs", (uint32_t)threadPool.GetCpus().size());
+
+		if (m_ScalingThreadCount > 0)
+			ImGui::Text("Scaling benchmark: %u/%u threads", m_ScalingThreadCount, GetMaxThreadCount());
+		else if (ImGui::Button("Scaling benchmark"))
+			StartScalingBenchmark();
+
+		if (!m_benchmark.GetScalingResults().empty() && ImGui::BeginTable("Scaling", 4))
+		{
+			ImGui::TableSetupColumn("Threads");
+			ImGui::TableSetupColumn("Frame (ms)");
+			ImGui::TableSetupColumn("Speedup");
+			ImGui::TableSetupColumn("Efficiency");
+			ImGui::TableHeadersRow();
+
+			for (const Benchmark::ScalingResult& result : m_benchmark.GetScalingResults())
+			{
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("%u", result.ThreadCount);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", result.FrameTime);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.2fx", result.Speedup);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.0f%%", result.Efficiency * 100.0f);
+			}
+			ImGui::EndTable();
 		}
 
 		ImGui::Separator();
 
+		ImGui::InputText("Sequence", m_SequencePath, sizeof(m_SequencePath));
+		if (m_Sequence.IsRunning())
+		{
+			ImGui::Text("Rendering frame %u/%u", m_Sequence.GetCompletedFrames() + 1, m_Sequence.GetFrameCount());
+			if (ImGui::Button("Cancel sequence"))
+				m_Sequence.Cancel();
+		}
+		else
+		{
+			if (ImGui::Button("Render sequence"))
+				StartSequence();
+
+			if (m_Sequence.GetTotalTime() > 0.0f)
+			{
+				ImGui::Text("Sequence: %u frames, trace %.2fs, total %.2fs", m_Sequence.GetCompletedFrames(),
+					m_Sequence.GetTraceTime(), m_Sequence.GetTotalTime());
+			}
+		}
+
 		ImGui::End();
 
 		ImGui::Begin("Scene");
 
 		ImGui::Text("Background color:");
 		ImGui::ColorEdit3("Background color", glm::value_ptr(m_Scene.BackgroundColor));
+		ImGui::InputText("Texture file", m_TexturePath, sizeof(m_TexturePath));
 		ImGui::Separator();
 
 		for (size_t i = 0; i < m_Scene.Materials.size(); i++)
@@ -91,6 +391,21 @@ public:
 			ImGui::ColorEdit3("Emission Color", glm::value_ptr(material.EmissionColor));
 			ImGui::DragFloat("Emission Power", &material.EmissionPower, 0.05f, 0.0f, FLT_MAX);
 
+			if (material.TextureIndex >= 0)
+			{
+				ImGui::Text("Texture: %s", m_Scene.Textures->GetTexture(material.TextureIndex).GetFilepath().c_str());
+				if (ImGui::Button("Remove texture"))
+				{
+					material.TextureIndex = -1;
+					ResetAccumulation();
+				}
+			}
+			else if (ImGui::Button("Load texture"))
+			{
+				material.TextureIndex = m_Scene.Textures->Load(m_TexturePath);
+				ResetAccumulation();
+			}
+
 			ImGui::Separator();
 			ImGui::PopID();
 		}
@@ -118,16 +433,155 @@ public:
 
 	void Render()
 	{
+		// The sequence gets all cores while it runs
+		if (m_Sequence.IsRunning())
+			return;
+
 		Timer timer;
 
-		m_Renderer.OnResize(m_ViewportWidth, m_ViewportHeight);
-		m_Camera.OnResize(m_ViewportWidth, m_ViewportHeight);
+		// A resumed render keeps the resolution of its checkpoint until the accumulation is reset
+		if (!m_FixedResolution)
+		{
+			m_RenderWidth = m_ViewportWidth;
+			m_RenderHeight = m_ViewportHeight;
+		}
+
+		m_Renderer.OnResize(m_RenderWidth, m_RenderHeight);
+		m_Camera.OnResize(m_RenderWidth, m_RenderHeight);
+
+		if (m_PendingResume)
+			ResumeFromCheckpoint();
+
+		// One thread count per UI frame keeps the window responsive during the sweep
+		if (m_ScalingThreadCount > 0)
+		{
+			RunScalingStep();
+			return;
+		}
+
 		m_Renderer.Render(m_Scene, m_Camera);
 
 		m_LastRenderTime = timer.ElapsedMillis();
 
 		m_benchmark.CalculateAverageRenderTime(m_LastRenderTime);
 
+		if (m_AutoCheckpoint && m_Renderer.GetSettings().Accumulate && m_CheckpointTimer.Elapsed() >= m_CheckpointInterval)
+			SaveCheckpoint();
+	}
+
+	void ResetAccumulation()
+	{
+		m_Renderer.ResetFrameIndex();
+		m_benchmark.ResetAverage();
+		m_FixedResolution = false;
+	}
+
+	void SaveCheckpoint()
+	{
+		m_CheckpointTimer.Reset();
+
+		// Without accumulation the radiance sums are stale and do not match the sample counts
+		if (!m_Renderer.GetSettings().Accumulate)
+		{
+			std::cout << "checkpoints need accumulation to be enabled" << std::endl;
+			return;
+		}
+
+		// Skipped rather than queued, the next interval writes a more recent state anyway
+		if (m_CheckpointWriter.IsBusy())
+			return;
+
+		Checkpoint checkpoint;
+		m_Renderer.CaptureCheckpoint(checkpoint);
+		checkpoint.SetView(m_Scene, m_Camera);
+
+		m_CheckpointWriter.WriteAsync(m_CheckpointPath, std::move(checkpoint));
+	}
+
+	void LoadCheckpoint()
+	{
+		// Applied on the next render, once the viewport exists
+		m_PendingResume = std::make_unique<Checkpoint>();
+		if (!m_PendingResume->ReadFromFile(m_CheckpointPath))
+			m_PendingResume.reset();
+	}
+
+	uint32_t GetMaxThreadCount() const
+	{
+		const std::vector<uint32_t>& cpus = m_Renderer.GetThreadPool().GetCpus();
+		return cpus.empty() ? ThreadPool::GetHardwareThreadCount() : (uint32_t)cpus.size();
+	}
+
+	void StartScalingBenchmark()
+	{
+		m_benchmark.ResetScaling();
+		m_ScalingThreadCount = 1;
+
+		std::cout << "threads,frame_ms,speedup,efficiency" << std::endl;
+	}
+
+	void RunScalingStep()
+	{
+		float frameTime = m_Renderer.BenchmarkThreads(m_Scene, m_Camera, m_ScalingThreadCount, 8);
+		const Benchmark::ScalingResult& result = m_benchmark.AddScalingResult(m_ScalingThreadCount, frameTime);
+		std::cout << result.ThreadCount << "," << result.FrameTime << "," << result.Speedup << "," << result.Efficiency << std::endl;
+
+		// The sweep rendered into the viewport's buffers, its accumulation and any resumed checkpoint are gone
+		if (++m_ScalingThreadCount > GetMaxThreadCount())
+		{
+			m_ScalingThreadCount = 0;
+			m_Renderer.ConfigureThreads((uint32_t)m_ThreadCount, m_Renderer.GetThreadPool().GetCpus());
+			ResetAccumulation();
+		}
+	}
+
+	bool StartSequence()
+	{
+		// Meshes are loaded once and stay resident for every following sequence
+		if (m_SequenceScene.Models.empty())
+			CreateScene(m_SequenceScene);
+
+		std::vector<SequenceFrame> frames;
+		if (!SequenceRenderer::LoadFromFile(m_SequencePath, m_SequenceScene, frames))
+			return false;
+
+		// Materials follow the edits made in the viewport
+		m_SequenceScene.Materials = m_Scene.Materials;
+
+		// The sequence thread updates and samples its textures while the UI keeps using the viewport's,
+		// so it gets a cache of its own loaded from the same files
+		std::shared_ptr<TextureCache> textures = std::make_shared<TextureCache>(m_Scene.Textures->GetBudget());
+		for (Material& material : m_SequenceScene.Materials)
+		{
+			if (material.TextureIndex >= 0)
+				material.TextureIndex = textures->Load(m_Scene.Textures->GetTexture(material.TextureIndex).GetFilepath());
+		}
+		m_SequenceScene.Textures = textures;
+		m_Sequence.Start(m_SequenceScene, std::move(frames), m_SequenceSettings);
+		return true;
+	}
+
+	void ResumeFromCheckpoint()
+	{
+		std::unique_ptr<Checkpoint> checkpoint = std::move(m_PendingResume);
+
+		m_Renderer.OnResize(checkpoint->Width, checkpoint->Height);
+		m_Camera.OnResize(checkpoint->Width, checkpoint->Height);
+
+		if (!checkpoint->MatchesView(m_Scene, m_Camera) || !m_Renderer.RestoreCheckpoint(*checkpoint))
+		{
+			std::cout << "checkpoint was rendered from a different scene or projection" << std::endl;
+			m_Renderer.OnResize(m_RenderWidth, m_RenderHeight);
+			m_Camera.OnResize(m_RenderWidth, m_RenderHeight);
+			return;
+		}
+
+		m_Camera.SetPose(checkpoint->CameraPosition, checkpoint->CameraDirection);
+		m_benchmark.ResetAverage();
+
+		m_RenderWidth = checkpoint->Width;
+		m_RenderHeight = checkpoint->Height;
+		m_FixedResolution = true;
 	}
 private:
 	Renderer m_Renderer;
@@ -135,7 +589,30 @@ private:
 	Camera m_Camera;
 	Scene m_Scene;
 	uint32_t m_ViewportWidth = 0, m_ViewportHeight = 0;
+	uint32_t m_RenderWidth = 0, m_RenderHeight = 0;
+	bool m_FixedResolution = false;
 	float m_LastRenderTime = 0.0f;
+	float m_SingleRayThroughput = 0.0f, m_PacketRayThroughput = 0.0f;
+
+	int m_ThreadCount = 0;
+	// Thread count of the next scaling benchmark step, 0 when no sweep is running
+	uint32_t m_ScalingThreadCount = 0;
+	bool m_ExitAfterScalingBenchmark = false;
+
+	char m_CheckpointPath[256] = {};
+	bool m_AutoCheckpoint = false;
+	float m_CheckpointInterval = 60.0f;
+	Timer m_CheckpointTimer;
+	CheckpointWriter m_CheckpointWriter;
+	std::unique_ptr<Checkpoint> m_PendingResume;
+
+	char m_TexturePath[256] = {};
+
+	char m_SequencePath[256] = {};
+	SequenceSettings m_SequenceSettings;
+	Scene m_SequenceScene;
+	SequenceRenderer m_Sequence;
+	bool m_ExitAfterSequence = false;
 
 };
 
@@ -144,8 +621,10 @@ Walnut::Application* Walnut::CreateApplication(int argc, char** argv)
 	Walnut::ApplicationSpecification spec;
 	spec.Name = "My Window";
 
+	AppOptions options = ParseCommandLine(argc, argv);
+
 	Walnut::Application* app = new Walnut::Application(spec);
-	app->PushLayer<ExampleLayer>();
+	app->PushLayer(std::make_shared<ExampleLayer>(options));
 	app->SetMenubarCallback([app]()
 		{
 			if (ImGui::BeginMenu("File"))